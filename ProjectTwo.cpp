@@ -1,348 +1,9281 @@
-// ProjectTwo.cpp
-// Author: Andres Cepeda
-// Description: ABCU Course Planner program. This program loads course data
-// from a file into a binary search tree, prints a sorted course list, and
-// shows information for an individual course, including its prerequisites.
-
-#include <iostream>
-#include <string>
-#include <vector>
-#include <fstream>
-#include <sstream>
-
-using namespace std;
-
-// -----------------------------
-// Data structures
-// -----------------------------
-
-// This struct holds the information for one course.
-struct Course {
-    string courseNumber;
-    string courseTitle;
-    vector<string> prerequisites;
-};
-
-// This struct is a node in the binary search tree.
-struct TreeNode {
-    Course courseData;
-    TreeNode* leftChild;
-    TreeNode* rightChild;
-
-    TreeNode(const Course& course)
-        : courseData(course), leftChild(nullptr), rightChild(nullptr) {}
-};
-
-// This class stores Course objects in a binary search tree ordered
-// by course number so they can be printed in alphanumeric order.
-class CourseBST {
-public:
-    CourseBST() : root(nullptr) {}
-
-    // Insert a course into the tree.
-    void insert(const Course& newCourse) {
-        insertHelper(root, newCourse);
-    }
-
-    // Search for a course by course number.
-    Course* search(const string& targetNumber) {
-        return searchHelper(root, targetNumber);
-    }
-
-    // Print all courses in alphanumeric order.
-    void printInOrder() const {
-        if (!root) {
-            cout << "No courses loaded." << endl;
-            return;
-        }
-        inOrderHelper(root);
-    }
-
-    // Clear all nodes from the tree.
-    void clear() {
-        clearHelper(root);
-        root = nullptr;
-    }
-
-private:
-    TreeNode* root;
-
-    // Helper function to insert a course into the tree.
-    void insertHelper(TreeNode*& node, const Course& newCourse) {
-        if (node == nullptr) {
-            node = new TreeNode(newCourse);
-            return;
-        }
-
-        if (newCourse.courseNumber < node->courseData.courseNumber) {
-            insertHelper(node->leftChild, newCourse);
-        }
-        else if (newCourse.courseNumber > node->courseData.courseNumber) {
-            insertHelper(node->rightChild, newCourse);
-        }
-        else {
-            // If the course already exists, update its data.
-            node->courseData.courseTitle = newCourse.courseTitle;
-            node->courseData.prerequisites = newCourse.prerequisites;
-        }
-    }
-
-    // Helper function to search for a course in the tree.
-    Course* searchHelper(TreeNode* node, const string& targetNumber) {
-        if (node == nullptr) {
-            return nullptr;
-        }
-
-        if (targetNumber == node->courseData.courseNumber) {
-            return &(node->courseData);
-        }
-        else if (targetNumber < node->courseData.courseNumber) {
-            return searchHelper(node->leftChild, targetNumber);
-        }
-        else {
-            return searchHelper(node->rightChild, targetNumber);
-        }
-    }
-
-    // Helper function to print the tree in order.
-    void inOrderHelper(TreeNode* node) const {
-        if (node == nullptr) {
-            return;
-        }
-
-        inOrderHelper(node->leftChild);
-        cout << node->courseData.courseNumber << ", "
-             << node->courseData.courseTitle << endl;
-        inOrderHelper(node->rightChild);
-    }
-
-    // Helper function to delete all nodes in the tree.
-    void clearHelper(TreeNode* node) {
-        if (node == nullptr) {
-            return;
-        }
-        clearHelper(node->leftChild);
-        clearHelper(node->rightChild);
-        delete node;
-    }
-};
-
-// -----------------------------
-// Utility functions
-// -----------------------------
-
-// Trim whitespace from the beginning and end of a string.
-string trim(const string& s) {
-    size_t start = s.find_first_not_of(" \t\r\n");
-    if (start == string::npos) {
-        return "";
-    }
-    size_t end = s.find_last_not_of(" \t\r\n");
-    return s.substr(start, end - start + 1);
-}
-
-// Split a line into tokens using a single-character delimiter.
-vector<string> split(const string& line, char delimiter) {
-    vector<string> tokens;
-    string token;
-    stringstream ss(line);
-
-    while (getline(ss, token, delimiter)) {
-        tokens.push_back(token);
-    }
-
-    return tokens;
-}
-
-// Convert a string to uppercase. This helps keep course lookups consistent.
-string toUpper(const string& s) {
-    string result = s;
-    for (char& c : result) {
-        c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
-    }
-    return result;
-}
-
-// -----------------------------
-// File loading
-// -----------------------------
-
-// Load course data from a CSV file and store it in the tree.
-// Returns true if the load is successful.
-bool loadCoursesFromFile(const string& fileName, CourseBST& tree) {
-    ifstream inputFile(fileName);
-    if (!inputFile.is_open()) {
-        cout << "Error opening file: " << fileName << endl;
-        return false;
-    }
-
-    // Clear any existing data before loading new courses.
-    tree.clear();
-
-    string line;
-    int lineNumber = 0;
-
-    while (getline(inputFile, line)) {
-        lineNumber++;
-
-        // Skip empty lines so they do not cause errors.
-        if (trim(line).empty()) {
-            continue;
-        }
-
-        vector<string> tokens = split(line, ',');
-
-        // Each line should have at least a course number and a course title.
-        if (tokens.size() < 2) {
-            cout << "File format error on line " << lineNumber
-                 << ": fewer than two fields." << endl;
-            cout << "Offending line: " << line << endl;
-            // Skip this line and continue with the rest.
-            continue;
-        }
-
-        Course course;
-        course.courseNumber = trim(tokens[0]);
-        course.courseTitle = trim(tokens[1]);
-
-        // Any remaining tokens are prerequisites.
-        for (size_t i = 2; i < tokens.size(); ++i) {
-            string prereqId = trim(tokens[i]);
-            if (!prereqId.empty()) {
-                course.prerequisites.push_back(prereqId);
-            }
-        }
-
-        // Only insert the course if it has both a number and a title.
-        if (!course.courseNumber.empty() && !course.courseTitle.empty()) {
-            tree.insert(course);
-        }
-        else {
-            cout << "File format warning on line " << lineNumber
-                 << ": missing course number or title." << endl;
-        }
-    }
-
-    inputFile.close();
-    cout << "Courses successfully loaded from file: " << fileName << endl;
-    return true;
-}
-
-// -----------------------------
-// Printing functions
-// -----------------------------
-
-// Print detailed information for one course, including its prerequisites.
-void printCourseInformation(CourseBST& tree, const string& targetNumber) {
-    string searchNumber = toUpper(targetNumber);
-    Course* found = tree.search(searchNumber);
-
-    if (found == nullptr) {
-        cout << "Course " << searchNumber << " not found." << endl;
-        return;
-    }
-
-    cout << endl;
-    cout << found->courseNumber << ", " << found->courseTitle << endl;
-
-    if (found->prerequisites.empty()) {
-        cout << "Prerequisites: None" << endl;
-    }
-    else {
-        cout << "Prerequisites:" << endl;
-
-        // For each prerequisite, try to print its number and title.
-        for (const string& prereqIdRaw : found->prerequisites) {
-            string prereqId = toUpper(prereqIdRaw);
-            Course* prereqCourse = tree.search(prereqId);
-
-            if (prereqCourse != nullptr) {
-                cout << "  " << prereqCourse->courseNumber
-                     << ", " << prereqCourse->courseTitle << endl;
-            }
-            else {
-                // If the prerequisite is not in the tree, at least show its ID.
-                cout << "  " << prereqId << " (course not found in data)" << endl;
-            }
-        }
-    }
-}
-
-// -----------------------------
-// Menu and main program
-// -----------------------------
-
-// Print the main menu for the user.
-void printMenu() {
-    cout << endl;
-    cout << "*******************************" << endl;
-    cout << "Welcome to the ABCU Course Planner" << endl;
-    cout << "*******************************" << endl;
-    cout << "1. Load Data Structure" << endl;
-    cout << "2. Print Course List" << endl;
-    cout << "3. Print Course" << endl;
-    cout << "9. Exit" << endl;
-    cout << "Please enter your choice: ";
-}
-
-int main() {
-    CourseBST courseTree;
-    bool dataLoaded = false;
-    string fileName;
-    string userChoice;
-
-    // Loop until the user chooses to exit.
-    while (true) {
-        printMenu();
-        getline(cin, userChoice);
-
-        if (userChoice == "1") {
-            cout << "Enter course data file name: ";
-            getline(cin, fileName);
-
-            if (fileName.empty()) {
-                cout << "File name cannot be empty." << endl;
-                continue;
-            }
-
-            dataLoaded = loadCoursesFromFile(fileName, courseTree);
-        }
-        else if (userChoice == "2") {
-            if (!dataLoaded) {
-                cout << "Please load the data structure first (option 1)." << endl;
-            }
-            else {
-                cout << endl;
-                cout << "Here is the list of courses:" << endl;
-                courseTree.printInOrder();
-            }
-        }
-        else if (userChoice == "3") {
-            if (!dataLoaded) {
-                cout << "Please load the data structure first (option 1)." << endl;
-            }
-            else {
-                string searchNumber;
-                cout << "Please enter the course number (for example, CS200): ";
-                getline(cin, searchNumber);
-
-                if (searchNumber.empty()) {
-                    cout << "Course number cannot be empty." << endl;
-                }
-                else {
-                    printCourseInformation(courseTree, searchNumber);
-                }
-            }
-        }
-        else if (userChoice == "9") {
-            cout << "Thank you for using the ABCU Course Planner. Goodbye!" << endl;
-            break;
-        }
-        else {
-            // Handle any menu choices that are not valid.
-            cout << "Invalid choice. Please enter 1, 2, 3, or 9." << endl;
-        }
-    }
-
-    return 0;
-}
+// ProjectTwo.cpp
+// Author: Andres Cepeda
+// Description: ABCU Course Planner program. This program loads course data
+// from a file into a binary search tree, prints a sorted course list, and
+// shows information for an individual course, including its prerequisites.
+// Build with a C++17 compiler. Compressed catalog files are read when the
+// program is built with -DABCU_WITH_ZLIB -lz (gzip) or -DABCU_WITH_ZSTD
+// -lzstd (zstd). Courses added, updated or removed in the program are saved
+// in <file>.snapshot and <file>.journal next to the first course file.
+// Building with -DABCU_EMBEDDED_CATALOG='"<header>"' compiles in a catalog
+// written by --embed, which is then loaded at startup. Catalogs too large
+// for memory can be written as a disk archive with --archive-build and read
+// a page at a time. --huge-pages puts the tree's nodes on huge pages, and
+// --numa-replicas gives each NUMA node its own copy of the catalog for
+// --audit.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <queue>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <memory>
+#include <new>
+#include <functional>
+#include <cctype>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <string_view>
+#include <unordered_set>
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <sched.h>
+#endif
+
+#ifdef ABCU_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef ABCU_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+// -----------------------------
+// Data structures
+// -----------------------------
+
+// This struct holds the information for one course.
+struct Course {
+    string courseNumber;
+    string courseTitle;
+    vector<string> prerequisites;
+    vector<string> aliases;   // cross-listed course numbers, e.g. MATH350 for CS350
+
+    // The prerequisites as a boolean expression such as
+    // "CS200 and (MATH201 or MATH210)". Empty when every course in
+    // prerequisites is required, which is the usual case.
+    string prerequisiteRule;
+
+    // Optional columns, read only from files whose header line names
+    // them. Zero or empty means the file did not give a value.
+    uint8_t creditHours = 0;
+    uint8_t termsOffered = 0;   // termFall | termSpring | ...
+    string campus;
+};
+
+// Bits of Course::termsOffered.
+constexpr uint8_t termFall = 1;
+constexpr uint8_t termSpring = 2;
+constexpr uint8_t termSummer = 4;
+constexpr uint8_t termWinter = 8;
+
+// This struct is a node in the binary search tree. A node for a
+// cross-listed course number only holds the number and points at the node
+// with the course data through aliasOf.
+struct TreeNode {
+    Course courseData;
+    TreeNode* leftChild;
+    TreeNode* rightChild;
+    TreeNode* aliasOf;
+
+    TreeNode(const Course& course)
+        : courseData(course), leftChild(nullptr), rightChild(nullptr), aliasOf(nullptr) {}
+
+    TreeNode(Course&& course)
+        : courseData(move(course)), leftChild(nullptr), rightChild(nullptr), aliasOf(nullptr) {}
+};
+
+// How the memory for tree nodes is backed. Huge pages let one TLB entry
+// cover 2 MB of nodes instead of 4 KB, which matters when a search visits
+// twenty nodes spread over hundreds of megabytes.
+enum class PageBacking : uint8_t {
+    Default,       // whatever the operating system chooses
+    Small,         // 4 KB pages only
+    Transparent,   // transparent huge pages, requested with madvise
+    Explicit,      // reserved huge pages from MAP_HUGETLB
+};
+
+// Read a page backing name as given to --huge-pages. Returns false if the
+// name is not one.
+bool parsePageBacking(const string& name, PageBacking& backing) {
+    if (name == "default") {
+        backing = PageBacking::Default;
+    }
+    else if (name == "off") {
+        backing = PageBacking::Small;
+    }
+    else if (name == "transparent") {
+        backing = PageBacking::Transparent;
+    }
+    else if (name == "explicit") {
+        backing = PageBacking::Explicit;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+const char* pageBackingName(PageBacking backing) {
+    switch (backing) {
+    case PageBacking::Small:
+        return "4 KB pages";
+    case PageBacking::Transparent:
+        return "transparent huge pages";
+    case PageBacking::Explicit:
+        return "explicit huge pages";
+    default:
+        return "default pages";
+    }
+}
+
+// Allocates tree nodes from 2 MB chunks so the nodes a search visits are
+// packed together and the chunks can be backed by huge pages. Course
+// numbers are short enough for std::string to keep them inside the node,
+// so a search touches no other memory. Removed nodes are reused before
+// the next chunk is started. On Linux the chunks are mapped with mmap; a
+// request for explicit huge pages falls back to transparent ones if none
+// are reserved. Elsewhere the chunks come from operator new.
+class NodeArena {
+public:
+    static constexpr size_t chunkSize = size_t(2) << 20;
+
+    NodeArena() = default;
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    ~NodeArena() {
+        releaseAll();
+    }
+
+    // The backing used for chunks mapped from now on.
+    void setBacking(PageBacking requested) {
+        backing = requested;
+    }
+
+    // The backing of the most recent chunk, after any fallback.
+    PageBacking chunkBacking() const {
+        return lastChunkBacking;
+    }
+
+    size_t chunkCount() const {
+        return chunks.size();
+    }
+
+    template <typename... Args>
+    TreeNode* create(Args&&... args) {
+        void* slot;
+        if (freeSlots != nullptr) {
+            slot = freeSlots;
+            freeSlots = freeSlots->next;
+        }
+        else {
+            if (chunkUsed + sizeof(TreeNode) > chunkSize || chunks.empty()) {
+                chunks.push_back(mapChunk());
+                chunkUsed = 0;
+            }
+            slot = chunks.back() + chunkUsed;
+            chunkUsed += sizeof(TreeNode);
+        }
+        return new (slot) TreeNode(forward<Args>(args)...);
+    }
+
+    void destroy(TreeNode* node) {
+        node->~TreeNode();
+        FreeSlot* slot = reinterpret_cast<FreeSlot*>(node);
+        slot->next = freeSlots;
+        freeSlots = slot;
+    }
+
+    // Return every chunk to the operating system. The nodes must already
+    // have been destroyed.
+    void releaseAll() {
+        for (char* chunk : chunks) {
+#if defined(__linux__)
+            munmap(chunk, chunkSize);
+#else
+            ::operator delete(chunk);
+#endif
+        }
+        chunks.clear();
+        chunkUsed = 0;
+        freeSlots = nullptr;
+    }
+
+private:
+    static_assert(sizeof(TreeNode) % alignof(TreeNode) == 0, "nodes must stay aligned");
+
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    PageBacking backing = PageBacking::Default;
+    PageBacking lastChunkBacking = PageBacking::Default;
+    vector<char*> chunks;
+    size_t chunkUsed = 0;
+    FreeSlot* freeSlots = nullptr;
+
+    char* mapChunk() {
+#if defined(__linux__)
+        lastChunkBacking = backing;
+        if (backing == PageBacking::Explicit) {
+            void* chunk = mmap(nullptr, chunkSize, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (chunk != MAP_FAILED) {
+                return static_cast<char*>(chunk);
+            }
+            lastChunkBacking = PageBacking::Transparent;
+        }
+
+        // A huge page can only back a 2 MB aligned range, so map one chunk
+        // more than needed and unmap the unaligned ends.
+        void* mapped = mmap(nullptr, 2 * chunkSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) {
+            throw bad_alloc();
+        }
+        uintptr_t start = reinterpret_cast<uintptr_t>(mapped);
+        uintptr_t aligned = (start + chunkSize - 1) & ~(uintptr_t(chunkSize) - 1);
+        if (aligned > start) {
+            munmap(mapped, aligned - start);
+        }
+        if (aligned + chunkSize < start + 2 * chunkSize) {
+            munmap(reinterpret_cast<void*>(aligned + chunkSize), start + chunkSize - aligned);
+        }
+
+        char* chunk = reinterpret_cast<char*>(aligned);
+        if (lastChunkBacking == PageBacking::Transparent) {
+            madvise(chunk, chunkSize, MADV_HUGEPAGE);
+        }
+        else if (lastChunkBacking == PageBacking::Small) {
+            madvise(chunk, chunkSize, MADV_NOHUGEPAGE);
+        }
+        return chunk;
+#else
+        lastChunkBacking = PageBacking::Default;
+        return static_cast<char*>(::operator new(chunkSize));
+#endif
+    }
+};
+
+// Shape statistics for the binary search tree. Depths start at 1 for the
+// root, so a node's depth is the number of nodes searchHelper visits to
+// find it. Cross-listed numbers have nodes of their own and are counted.
+struct TreeStats {
+    size_t nodeCount = 0;
+    size_t height = 0;
+    size_t totalDepth = 0;
+    vector<size_t> depthHistogram;   // depthHistogram[d] = nodes at depth d
+
+    double averageDepth() const {
+        return nodeCount == 0 ? 0.0 : static_cast<double>(totalDepth) / nodeCount;
+    }
+
+    // Height of a perfectly balanced tree with the same number of nodes.
+    size_t idealHeight() const {
+        size_t levels = 0;
+        for (size_t n = nodeCount; n > 0; n >>= 1) {
+            levels++;
+        }
+        return levels;
+    }
+};
+
+// This class stores Course objects in a binary search tree ordered
+// by course number so they can be printed in alphanumeric order.
+class CourseBST {
+public:
+    CourseBST() : root(nullptr), sourceHash(0) {}
+
+    ~CourseBST() {
+        clear();
+    }
+
+    // Choose how the memory for nodes added from now on is backed. Call it
+    // before loading so every node gets the same backing.
+    void setPageBacking(PageBacking backing) {
+        nodes.setBacking(backing);
+    }
+
+    // The backing the nodes actually got, after any fallback.
+    PageBacking getPageBacking() const {
+        return nodes.chunkBacking();
+    }
+
+    // Insert a course into the tree.
+    void insert(const Course& newCourse) {
+        insertHelper(root, newCourse);
+    }
+
+    // Replace the contents of the tree with courses that are already sorted
+    // by course number and have no duplicates. Building from the middle of
+    // each range keeps the tree balanced no matter how large it is.
+    void buildFromSorted(vector<Course> sortedCourses) {
+        clear();
+        root = buildHelper(sortedCourses, 0, sortedCourses.size());
+    }
+
+    // Add a cross-listed course number that refers to a course already in
+    // the tree. Returns false if that course is missing or the alias
+    // number is already in use.
+    bool addAlias(const string& aliasNumber, const string& canonicalNumber) {
+        TreeNode* target = findNode(canonicalNumber);
+        if (target == nullptr || target->aliasOf != nullptr) {
+            return false;
+        }
+
+        TreeNode** link = &root;
+        while (*link != nullptr) {
+            if (aliasNumber < (*link)->courseData.courseNumber) {
+                link = &(*link)->leftChild;
+            }
+            else if (aliasNumber > (*link)->courseData.courseNumber) {
+                link = &(*link)->rightChild;
+            }
+            else {
+                return false;
+            }
+        }
+
+        Course alias;
+        alias.courseNumber = aliasNumber;
+        *link = nodes.create(move(alias));
+        (*link)->aliasOf = target;
+        return true;
+    }
+
+    // Remove a course and its cross-listed numbers. Returns false if the
+    // course is missing or the number is only an alias.
+    bool remove(const string& courseNumber) {
+        TreeNode* node = findNode(courseNumber);
+        if (node == nullptr || node->aliasOf != nullptr) {
+            return false;
+        }
+
+        vector<string> aliases = node->courseData.aliases;
+        removeNode(courseNumber);
+        for (const string& alias : aliases) {
+            removeNode(alias);
+        }
+        return true;
+    }
+
+    // Search for a course by course number. A cross-listed number resolves
+    // to the course it is an alias of.
+    Course* search(string_view targetNumber) {
+        return searchHelper(root, targetNumber);
+    }
+
+    // Print all courses in alphanumeric order.
+    void printInOrder() const {
+        if (!root) {
+            cout << "No courses loaded." << endl;
+            return;
+        }
+        inOrderHelper(root);
+    }
+
+    // Collect pointers to every course in course number order. The walk
+    // uses an explicit stack so a degenerate tree cannot overflow the call
+    // stack.
+    void collectInOrder(vector<Course*>& courses) {
+        vector<TreeNode*> pending;
+        TreeNode* node = root;
+        while (node != nullptr || !pending.empty()) {
+            while (node != nullptr) {
+                pending.push_back(node);
+                node = node->leftChild;
+            }
+            node = pending.back();
+            pending.pop_back();
+            if (node->aliasOf == nullptr) {
+                courses.push_back(&node->courseData);
+            }
+            node = node->rightChild;
+        }
+    }
+
+    // Compute node count, height and the depth of every node in a single
+    // traversal. The traversal uses an explicit stack so a degenerate tree
+    // cannot overflow the call stack.
+    TreeStats computeStats() const {
+        TreeStats stats;
+        stats.depthHistogram.push_back(0);
+
+        vector<pair<const TreeNode*, size_t>> pending;
+        if (root != nullptr) {
+            pending.push_back({ root, 1 });
+        }
+        while (!pending.empty()) {
+            const TreeNode* node = pending.back().first;
+            size_t depth = pending.back().second;
+            pending.pop_back();
+
+            stats.nodeCount++;
+            stats.totalDepth += depth;
+            if (depth > stats.height) {
+                stats.height = depth;
+                stats.depthHistogram.resize(depth + 1, 0);
+            }
+            stats.depthHistogram[depth]++;
+
+            if (node->leftChild != nullptr) {
+                pending.push_back({ node->leftChild, depth + 1 });
+            }
+            if (node->rightChild != nullptr) {
+                pending.push_back({ node->rightChild, depth + 1 });
+            }
+        }
+        return stats;
+    }
+
+    // Clear all nodes from the tree.
+    void clear() {
+        clearHelper(root);
+        nodes.releaseAll();
+        root = nullptr;
+        sourceHash = 0;
+    }
+
+    // Return true if no courses are stored in the tree.
+    bool isEmpty() const {
+        return root == nullptr;
+    }
+
+    // Content hash of the file the current courses were loaded from.
+    // A value of 0 means the tree was not loaded from a file.
+    uint64_t getSourceHash() const {
+        return sourceHash;
+    }
+
+    void setSourceHash(uint64_t hash) {
+        sourceHash = hash;
+    }
+
+private:
+    TreeNode* root;
+    uint64_t sourceHash;
+    NodeArena nodes;
+
+    // Helper function to insert a course into the tree.
+    void insertHelper(TreeNode*& node, const Course& newCourse) {
+        if (node == nullptr) {
+            node = nodes.create(newCourse);
+            return;
+        }
+
+        if (newCourse.courseNumber < node->courseData.courseNumber) {
+            insertHelper(node->leftChild, newCourse);
+        }
+        else if (newCourse.courseNumber > node->courseData.courseNumber) {
+            insertHelper(node->rightChild, newCourse);
+        }
+        else {
+            // If the course already exists, update its data. Updating a
+            // cross-listed number updates the course it refers to.
+            TreeNode* target = node->aliasOf != nullptr ? node->aliasOf : node;
+            target->courseData.courseTitle = newCourse.courseTitle;
+            target->courseData.prerequisites = newCourse.prerequisites;
+            target->courseData.prerequisiteRule = newCourse.prerequisiteRule;
+        }
+    }
+
+    // Helper function to build a balanced subtree from sortedCourses[first, last).
+    TreeNode* buildHelper(vector<Course>& sortedCourses, size_t first, size_t last) {
+        if (first >= last) {
+            return nullptr;
+        }
+
+        size_t middle = first + (last - first) / 2;
+        TreeNode* node = nodes.create(move(sortedCourses[middle]));
+        node->leftChild = buildHelper(sortedCourses, first, middle);
+        node->rightChild = buildHelper(sortedCourses, middle + 1, last);
+        return node;
+    }
+
+    // Helper function to search for a course in the tree.
+    Course* searchHelper(TreeNode* node, string_view targetNumber) {
+        if (node == nullptr) {
+            return nullptr;
+        }
+
+        if (targetNumber == node->courseData.courseNumber) {
+            // One extra hop for a cross-listed number.
+            if (node->aliasOf != nullptr) {
+                return &(node->aliasOf->courseData);
+            }
+            return &(node->courseData);
+        }
+        else if (targetNumber < node->courseData.courseNumber) {
+            return searchHelper(node->leftChild, targetNumber);
+        }
+        else {
+            return searchHelper(node->rightChild, targetNumber);
+        }
+    }
+
+    // Find the node stored under a course number without following aliases.
+    TreeNode* findNode(const string& targetNumber) const {
+        TreeNode* node = root;
+        while (node != nullptr && node->courseData.courseNumber != targetNumber) {
+            node = targetNumber < node->courseData.courseNumber ? node->leftChild
+                                                                : node->rightChild;
+        }
+        return node;
+    }
+
+    // Unlink and delete the node stored under a course number. A node with
+    // two children is replaced by its in-order successor node itself rather
+    // than by a copy of the successor's data, so alias nodes that point at
+    // the successor stay valid.
+    void removeNode(const string& targetNumber) {
+        TreeNode** link = &root;
+        while (*link != nullptr && (*link)->courseData.courseNumber != targetNumber) {
+            link = targetNumber < (*link)->courseData.courseNumber ? &(*link)->leftChild
+                                                                   : &(*link)->rightChild;
+        }
+        TreeNode* node = *link;
+        if (node == nullptr) {
+            return;
+        }
+
+        if (node->leftChild == nullptr) {
+            *link = node->rightChild;
+        }
+        else if (node->rightChild == nullptr) {
+            *link = node->leftChild;
+        }
+        else {
+            TreeNode** successorLink = &node->rightChild;
+            while ((*successorLink)->leftChild != nullptr) {
+                successorLink = &(*successorLink)->leftChild;
+            }
+            TreeNode* successor = *successorLink;
+            *successorLink = successor->rightChild;
+            successor->leftChild = node->leftChild;
+            successor->rightChild = node->rightChild;
+            *link = successor;
+        }
+        nodes.destroy(node);
+    }
+
+    // Helper function to print the tree in order. Cross-listed numbers are
+    // printed with the course they refer to instead of on their own.
+    void inOrderHelper(TreeNode* node) const {
+        if (node == nullptr) {
+            return;
+        }
+
+        inOrderHelper(node->leftChild);
+        if (node->aliasOf == nullptr) {
+            cout << node->courseData.courseNumber << ", "
+                 << node->courseData.courseTitle << endl;
+        }
+        inOrderHelper(node->rightChild);
+    }
+
+    // Helper function to delete all nodes in the tree.
+    void clearHelper(TreeNode* node) {
+        if (node == nullptr) {
+            return;
+        }
+        clearHelper(node->leftChild);
+        clearHelper(node->rightChild);
+        nodes.destroy(node);
+    }
+};
+
+// -----------------------------
+// Utility functions
+// -----------------------------
+
+// Trim whitespace from the beginning and end of a string.
+string trim(const string& s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == string::npos) {
+        return "";
+    }
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+// Split a line into tokens using a single-character delimiter.
+vector<string> split(const string& line, char delimiter) {
+    vector<string> tokens;
+    string token;
+    stringstream ss(line);
+
+    while (getline(ss, token, delimiter)) {
+        tokens.push_back(token);
+    }
+
+    return tokens;
+}
+
+// Convert a string to uppercase. This helps keep course lookups consistent.
+string toUpper(const string& s) {
+    string result = s;
+    for (char& c : result) {
+        c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+    }
+    return result;
+}
+
+// Read the term bit for a term name such as "Fall" or "FA". Returns 0 if
+// the name is not a term.
+uint8_t parseTermName(const string& name) {
+    string term = toUpper(trim(name));
+    if (term == "FALL" || term == "FA") {
+        return termFall;
+    }
+    if (term == "SPRING" || term == "SP") {
+        return termSpring;
+    }
+    if (term == "SUMMER" || term == "SU") {
+        return termSummer;
+    }
+    if (term == "WINTER" || term == "WI") {
+        return termWinter;
+    }
+    return 0;
+}
+
+// Read a list of terms such as "Fall/Spring" or "FA SP SU" into term
+// bits. The names may be separated by spaces, '/', ';' or '|'. Returns
+// false if any name is not a term.
+bool parseTermList(const string& text, uint8_t& terms) {
+    terms = 0;
+    string name;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        if (i < text.size() && string(" \t/;|").find(text[i]) == string::npos) {
+            name += text[i];
+            continue;
+        }
+        if (name.empty()) {
+            continue;
+        }
+        uint8_t bit = parseTermName(name);
+        if (bit == 0) {
+            return false;
+        }
+        terms |= bit;
+        name.clear();
+    }
+    return true;
+}
+
+// Format term bits as a list such as "Fall, Spring".
+string formatTermList(uint8_t terms) {
+    static const char* const names[] = { "Fall", "Spring", "Summer", "Winter" };
+    string text;
+    for (int bit = 0; bit < 4; ++bit) {
+        if (terms & (1u << bit)) {
+            text += text.empty() ? names[bit] : string(", ") + names[bit];
+        }
+    }
+    return text;
+}
+
+// Seconds elapsed since the given start time.
+double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// A course number in canonical form: upper-case letters and digits with
+// all spaces and punctuation removed, so "cs 200", "CS-200" and "cs200 "
+// all become "CS200". The characters are stored inline so making a key
+// never allocates, which matters because every lookup makes one.
+struct CourseKey {
+    static constexpr size_t capacity = 15;
+
+    char text[capacity + 1];
+    uint8_t length;
+    bool valid;   // false if the input had more than capacity characters
+
+    string_view view() const {
+        return string_view(text, length);
+    }
+
+    bool empty() const {
+        return length == 0;
+    }
+};
+
+// Build the canonical key for a course number in a single pass.
+CourseKey canonicalCourseKey(string_view input) {
+    CourseKey key;
+    key.length = 0;
+    key.valid = true;
+
+    for (char c : input) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (!isalnum(u)) {
+            continue;
+        }
+        if (key.length == CourseKey::capacity) {
+            key.valid = false;
+            break;
+        }
+        key.text[key.length++] = static_cast<char>(toupper(u));
+    }
+    key.text[key.length] = '\0';
+    return key;
+}
+
+// -----------------------------
+// Content hashing
+// -----------------------------
+
+// Rotate a 64-bit value left by the given number of bits.
+inline uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Read 8 or 4 bytes from an unaligned position in a buffer.
+inline uint64_t readWord64(const unsigned char* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t readWord32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Compute a 64-bit hash of a block of memory using the XXH64 algorithm.
+// The main loop keeps four independent accumulators so the CPU can work on
+// 32 bytes per iteration, which makes the hash fast enough to run on every
+// load without noticeably adding to the load time.
+uint64_t hashContents(string_view data) {
+    const uint64_t prime1 = 11400714785074694791ULL;
+    const uint64_t prime2 = 14029467366897019727ULL;
+    const uint64_t prime3 = 1609587929392839161ULL;
+    const uint64_t prime4 = 9650029242287828579ULL;
+    const uint64_t prime5 = 2870177450012600261ULL;
+
+    auto round = [&](uint64_t acc, uint64_t input) {
+        acc += input * prime2;
+        acc = rotateLeft(acc, 31);
+        return acc * prime1;
+    };
+    auto mergeRound = [&](uint64_t acc, uint64_t value) {
+        acc ^= round(0, value);
+        return acc * prime1 + prime4;
+    };
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+    const unsigned char* end = p + data.size();
+    uint64_t hash;
+
+    if (data.size() >= 32) {
+        uint64_t v1 = prime1 + prime2;
+        uint64_t v2 = prime2;
+        uint64_t v3 = 0;
+        uint64_t v4 = 0 - prime1;
+        const unsigned char* limit = end - 32;
+        do {
+            v1 = round(v1, readWord64(p));
+            v2 = round(v2, readWord64(p + 8));
+            v3 = round(v3, readWord64(p + 16));
+            v4 = round(v4, readWord64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7)
+             + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        hash = mergeRound(hash, v1);
+        hash = mergeRound(hash, v2);
+        hash = mergeRound(hash, v3);
+        hash = mergeRound(hash, v4);
+    }
+    else {
+        hash = prime5;
+    }
+
+    hash += static_cast<uint64_t>(data.size());
+
+    while (p + 8 <= end) {
+        hash ^= round(0, readWord64(p));
+        hash = rotateLeft(hash, 27) * prime1 + prime4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        hash ^= static_cast<uint64_t>(readWord32(p)) * prime1;
+        hash = rotateLeft(hash, 23) * prime2 + prime3;
+        p += 4;
+    }
+    while (p < end) {
+        hash ^= static_cast<uint64_t>(*p) * prime5;
+        hash = rotateLeft(hash, 11) * prime1;
+        p++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// -----------------------------
+// Parallel helpers
+// -----------------------------
+
+// Number of worker threads to use for parallel work.
+size_t workerThreadCount() {
+    return max(1u, thread::hardware_concurrency());
+}
+
+// Split the range [0, count) into one contiguous block per worker thread
+// and call work(begin, end) for each block. Small ranges run on the
+// calling thread only.
+void parallelFor(size_t count, const function<void(size_t, size_t)>& work,
+                 size_t minimumPerThread = 4096) {
+    size_t threadCount = min(workerThreadCount(), max<size_t>(1, count / minimumPerThread));
+    if (threadCount <= 1) {
+        work(0, count);
+        return;
+    }
+
+    vector<thread> workers;
+    size_t blockSize = (count + threadCount - 1) / threadCount;
+    for (size_t t = 1; t < threadCount; ++t) {
+        size_t begin = min(count, t * blockSize);
+        size_t end = min(count, begin + blockSize);
+        workers.emplace_back(work, begin, end);
+    }
+    work(0, min(count, blockSize));
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// Lets a fixed group of threads wait for each other between steps of a
+// computation. The last thread to arrive runs onComplete before any
+// thread is released, so it can set up the next step.
+class ThreadBarrier {
+public:
+    explicit ThreadBarrier(size_t participants) : threadCount(participants) {}
+
+    void arriveAndWait(const function<void()>& onComplete) {
+        unique_lock<mutex> lock(guard);
+        size_t arrivedGeneration = generation;
+        if (++arrived == threadCount) {
+            onComplete();
+            arrived = 0;
+            generation++;
+            released.notify_all();
+            return;
+        }
+        released.wait(lock, [&] { return generation != arrivedGeneration; });
+    }
+
+private:
+    size_t threadCount;
+    size_t arrived = 0;
+    size_t generation = 0;
+    mutex guard;
+    condition_variable released;
+};
+
+// -----------------------------
+// Prerequisite rules
+// -----------------------------
+
+// A prerequisite field may be an expression such as
+// "CS200 and (MATH201 or MATH210)". Expressions are kept in postfix form:
+// a list of course numbers and the operators "AND" and "OR", each operator
+// applying to the two values before it. "and" binds tighter than "or".
+
+// Deepest value stack a compiled rule may need.
+const size_t maxRuleStackDepth = 32;
+
+// Return true if a prerequisite field is an expression rather than a
+// single course number.
+bool isPrerequisiteExpression(const string& field) {
+    if (field.find_first_of("()&|") != string::npos) {
+        return true;
+    }
+    for (const string& word : split(field, ' ')) {
+        string upper = toUpper(trim(word));
+        if (upper == "AND" || upper == "OR") {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parses a prerequisite expression into postfix form.
+class PrerequisiteRuleParser {
+public:
+    // Returns false and sets error if the expression is not valid.
+    bool parse(const string& text, vector<string>& postfix, string& error) {
+        tokens.clear();
+        position = 0;
+        errorMessage.clear();
+        output = &postfix;
+        depth = 0;
+        maxDepth = 0;
+
+        if (tokenize(text)) {
+            parseOr();
+            if (errorMessage.empty() && position < tokens.size()) {
+                errorMessage = "unexpected '" + tokens[position] + "'";
+            }
+        }
+        if (errorMessage.empty() && maxDepth > maxRuleStackDepth - 1) {
+            errorMessage = "expression is nested too deeply";
+        }
+        error = errorMessage;
+        return errorMessage.empty();
+    }
+
+private:
+    vector<string> tokens;
+    size_t position = 0;
+    string errorMessage;
+    vector<string>* output = nullptr;
+    size_t depth = 0;
+    size_t maxDepth = 0;
+
+    // Split into parentheses, operators and course numbers. Words next to
+    // each other with no operator between them form one course number, so
+    // "CS 200 or MATH 210" works.
+    bool tokenize(const string& text) {
+        string number;
+        auto finishNumber = [&]() {
+            if (number.empty()) {
+                return true;
+            }
+            CourseKey key = canonicalCourseKey(number);
+            number.clear();
+            if (!key.valid || key.empty()) {
+                errorMessage = "course number is too long";
+                return false;
+            }
+            tokens.push_back(string(key.view()));
+            return true;
+        };
+
+        size_t i = 0;
+        while (i < text.size()) {
+            char c = text[i];
+            if (c == '(' || c == ')' || c == '&' || c == '|') {
+                if (!finishNumber()) {
+                    return false;
+                }
+                tokens.push_back(c == '&' ? "AND" : c == '|' ? "OR" : string(1, c));
+                i++;
+                continue;
+            }
+            if (isspace(static_cast<unsigned char>(c))) {
+                i++;
+                continue;
+            }
+
+            size_t start = i;
+            while (i < text.size() && !isspace(static_cast<unsigned char>(text[i]))
+                   && string("()&|").find(text[i]) == string::npos) {
+                i++;
+            }
+            string word = text.substr(start, i - start);
+            string upper = toUpper(word);
+            if (upper == "AND" || upper == "OR") {
+                if (!finishNumber()) {
+                    return false;
+                }
+                tokens.push_back(upper);
+            }
+            else {
+                number += word;
+            }
+        }
+        return finishNumber();
+    }
+
+    bool isOperand(const string& token) const {
+        return token != "(" && token != ")" && token != "AND" && token != "OR";
+    }
+
+    // Track the value stack depth the postfix program will need.
+    void emit(const string& token) {
+        output->push_back(token);
+        if (isOperand(token)) {
+            maxDepth = max(maxDepth, ++depth);
+        }
+        else {
+            depth--;
+        }
+    }
+
+    void parseOr() {
+        parseAnd();
+        while (errorMessage.empty() && position < tokens.size() && tokens[position] == "OR") {
+            position++;
+            parseAnd();
+            emit("OR");
+        }
+    }
+
+    void parseAnd() {
+        parseAtom();
+        while (errorMessage.empty() && position < tokens.size() && tokens[position] == "AND") {
+            position++;
+            parseAtom();
+            emit("AND");
+        }
+    }
+
+    void parseAtom() {
+        if (!errorMessage.empty()) {
+            return;
+        }
+        if (position >= tokens.size()) {
+            errorMessage = "expression ended too early";
+            return;
+        }
+        if (tokens[position] == "(") {
+            position++;
+            parseOr();
+            if (errorMessage.empty()) {
+                if (position >= tokens.size() || tokens[position] != ")") {
+                    errorMessage = "missing ')'";
+                    return;
+                }
+                position++;
+            }
+            return;
+        }
+        if (!isOperand(tokens[position])) {
+            errorMessage = "expected a course number before '" + tokens[position] + "'";
+            return;
+        }
+        emit(tokens[position++]);
+    }
+};
+
+// Parse a prerequisite expression into postfix form.
+bool parsePrerequisiteRule(const string& text, vector<string>& postfix, string& error) {
+    PrerequisiteRuleParser parser;
+    return parser.parse(text, postfix, error);
+}
+
+// Turn a postfix rule back into readable text, using describe to print
+// each course number. Whenever "and" and "or" are mixed, the inner part
+// is put in parentheses so readers do not need to know which binds
+// tighter.
+string formatPrerequisiteRule(const vector<string>& postfix,
+                              const function<string(const string&)>& describe) {
+    // Each entry holds the text of a sub-expression and its precedence:
+    // 1 for "or", 2 for "and", 3 for a single course.
+    vector<pair<string, int>> stack;
+    for (const string& token : postfix) {
+        if (token == "AND" || token == "OR") {
+            if (stack.size() < 2) {
+                return "";
+            }
+            pair<string, int> right = stack.back();
+            stack.pop_back();
+            pair<string, int> left = stack.back();
+            stack.pop_back();
+
+            int precedence = token == "AND" ? 2 : 1;
+            if (left.second != 3 && left.second != precedence) {
+                left.first = "(" + left.first + ")";
+            }
+            if (right.second != 3 && right.second != precedence) {
+                right.first = "(" + right.first + ")";
+            }
+            stack.push_back({ left.first + (token == "AND" ? " and " : " or ") + right.first,
+                              precedence });
+        }
+        else {
+            stack.push_back({ describe(token), 3 });
+        }
+    }
+    return stack.size() == 1 ? stack.back().first : "";
+}
+
+// -----------------------------
+// File loading
+// -----------------------------
+
+// Read the whole contents of a file into a string.
+// Returns false if the file could not be opened or read.
+bool readFileContents(const string& fileName, string& contents) {
+    ifstream inputFile(fileName, ios::binary);
+    if (!inputFile.is_open()) {
+        return false;
+    }
+
+    inputFile.seekg(0, ios::end);
+    streamoff size = inputFile.tellg();
+    if (size < 0) {
+        return false;
+    }
+    inputFile.seekg(0, ios::beg);
+
+    contents.resize(static_cast<size_t>(size));
+    if (size > 0 && !inputFile.read(&contents[0], size)) {
+        return false;
+    }
+    return true;
+}
+
+// The courses read from one catalog file, sorted by course number.
+struct ParsedCatalogFile {
+    string fileName;
+    bool opened = false;
+    uint64_t contentHash = 0;
+    string contents;   // the bytes read, released once they are parsed
+    vector<Course> courses;
+    vector<vector<string>> aliasGroups;   // from ALIAS lines
+    string messages;
+    string error;
+};
+
+// The fields a catalog file's columns can hold.
+enum class CatalogColumn : uint8_t {
+    Number,
+    Title,
+    Credits,
+    Terms,
+    Campus,
+    Prerequisites,   // this column and every column after it
+    Ignored
+};
+
+// Map a header line field such as "Credit Hours" to its column. Returns
+// Ignored for names that are not recognized.
+CatalogColumn catalogColumnForName(const string& name) {
+    string key;
+    for (char c : name) {
+        if (isalnum(static_cast<unsigned char>(c))) {
+            key += static_cast<char>(toupper(static_cast<unsigned char>(c)));
+        }
+    }
+    if (key == "NUMBER" || key == "COURSE" || key == "COURSENUMBER") {
+        return CatalogColumn::Number;
+    }
+    if (key == "TITLE" || key == "NAME" || key == "COURSETITLE") {
+        return CatalogColumn::Title;
+    }
+    if (key == "CREDITS" || key == "CREDIT" || key == "CREDITHOURS" || key == "HOURS") {
+        return CatalogColumn::Credits;
+    }
+    if (key == "TERMS" || key == "TERM" || key == "TERMSOFFERED") {
+        return CatalogColumn::Terms;
+    }
+    if (key == "CAMPUS") {
+        return CatalogColumn::Campus;
+    }
+    if (key == "PREREQUISITES" || key == "PREREQUISITE" || key == "PREREQS") {
+        return CatalogColumn::Prerequisites;
+    }
+    return CatalogColumn::Ignored;
+}
+
+// Parses catalog text into a sorted run of courses. The text can arrive
+// in blocks of any size (for example from a decompressor), and lines that
+// span two blocks are joined before they are parsed. Warnings are collected
+// in parsed.messages instead of printed so that several files can be
+// parsed at the same time.
+//
+// Without a header the columns are the course number, the title, and then
+// any number of prerequisites. A file may instead start with a header line
+// such as "Number,Title,Credits,Terms,Campus,Prerequisites" that names its
+// columns; the prerequisites column, if there is one, must come last.
+class CatalogParser {
+public:
+    explicit CatalogParser(ParsedCatalogFile& target)
+        : parsed(target), lineNumber(0), sawFirstLine(false),
+          columns{ CatalogColumn::Number, CatalogColumn::Title, CatalogColumn::Prerequisites } {}
+
+    // Parse every complete line in the block and keep any partial line
+    // until the next block arrives.
+    void feed(const char* data, size_t size) {
+        const char* end = data + size;
+        while (data < end) {
+            const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+            if (newline == nullptr) {
+                pendingLine.append(data, end);
+                return;
+            }
+
+            if (pendingLine.empty()) {
+                parseLine(string(data, newline));
+            }
+            else {
+                pendingLine.append(data, newline);
+                parseLine(pendingLine);
+                pendingLine.clear();
+            }
+            data = newline + 1;
+        }
+    }
+
+    // Parse the last line if the text did not end with a newline, then sort
+    // the run by course number.
+    void finish() {
+        if (!pendingLine.empty()) {
+            parseLine(pendingLine);
+            pendingLine.clear();
+        }
+
+        // The sort is stable, so when a file lists the same course twice
+        // the later line stays last and wins below.
+        stable_sort(parsed.courses.begin(), parsed.courses.end(),
+                    [](const Course& a, const Course& b) {
+                        return a.courseNumber < b.courseNumber;
+                    });
+
+        vector<Course> unique;
+        unique.reserve(parsed.courses.size());
+        for (Course& course : parsed.courses) {
+            if (!unique.empty() && unique.back().courseNumber == course.courseNumber) {
+                unique.back() = move(course);
+            }
+            else {
+                unique.push_back(move(course));
+            }
+        }
+        parsed.courses = move(unique);
+        flushMessages();
+    }
+
+    // Move the warnings written so far to parsed.messages, so a caller
+    // streaming a large file can print and clear them as it goes.
+    void flushMessages() {
+        parsed.messages += messages.str();
+        messages.str("");
+    }
+
+private:
+    ParsedCatalogFile& parsed;
+    ostringstream messages;
+    string pendingLine;
+    int lineNumber;
+    bool sawFirstLine;
+    vector<CatalogColumn> columns;
+
+    // The column a field belongs to. Fields past the last named column are
+    // more prerequisites if the last column is the prerequisites column.
+    CatalogColumn columnAt(size_t field) const {
+        if (field < columns.size()) {
+            return columns[field];
+        }
+        return columns.back() == CatalogColumn::Prerequisites ? CatalogColumn::Prerequisites
+                                                              : CatalogColumn::Ignored;
+    }
+
+    // Read a header line into columns. Returns false, leaving the columns
+    // unchanged, if the line is not a usable header.
+    bool readHeader(const vector<string>& tokens) {
+        vector<CatalogColumn> header;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            CatalogColumn column = catalogColumnForName(tokens[i]);
+            if (column == CatalogColumn::Ignored) {
+                messages << "File format warning in " << parsed.fileName
+                         << " on line " << lineNumber << ": column '" << trim(tokens[i])
+                         << "' is not recognized and will be ignored." << endl;
+            }
+            else if (find(header.begin(), header.end(), column) != header.end()) {
+                messages << "File format error in " << parsed.fileName
+                         << " on line " << lineNumber << ": column '" << trim(tokens[i])
+                         << "' is named twice." << endl;
+                return false;
+            }
+            else if (!header.empty() && header.back() == CatalogColumn::Prerequisites) {
+                messages << "File format error in " << parsed.fileName
+                         << " on line " << lineNumber
+                         << ": the prerequisites column must be the last column." << endl;
+                return false;
+            }
+            header.push_back(column);
+        }
+
+        if (find(header.begin(), header.end(), CatalogColumn::Title) == header.end()) {
+            messages << "File format error in " << parsed.fileName
+                     << " on line " << lineNumber
+                     << ": the header line has no title column." << endl;
+            return false;
+        }
+        columns = move(header);
+        return true;
+    }
+
+    // Read a credit hours field. An empty field means not given.
+    bool readCredits(const string& token, uint8_t& credits) {
+        string text = trim(token);
+        uint32_t value = 0;
+        for (char c : text) {
+            if (!isdigit(static_cast<unsigned char>(c)) || value > UINT8_MAX) {
+                value = UINT8_MAX + 1;
+                break;
+            }
+            value = value * 10 + static_cast<uint32_t>(c - '0');
+        }
+        if (value > UINT8_MAX) {
+            messages << "File format warning in " << parsed.fileName
+                     << " on line " << lineNumber << ": credit hours '" << text
+                     << "' are not a whole number from 0 to " << UINT8_MAX << "." << endl;
+            return false;
+        }
+        credits = static_cast<uint8_t>(value);
+        return true;
+    }
+
+    // Convert a course number from the file to canonical form. Returns
+    // false and records a warning if the number is too long.
+    bool readCourseNumber(const string& token, string& number) {
+        CourseKey key = canonicalCourseKey(token);
+        if (!key.valid) {
+            messages << "File format warning in " << parsed.fileName
+                     << " on line " << lineNumber << ": course number '" << trim(token)
+                     << "' is longer than " << CourseKey::capacity << " characters." << endl;
+            return false;
+        }
+        number.assign(key.text, key.length);
+        return true;
+    }
+
+    // Parse one line of the file into a course.
+    void parseLine(const string& line) {
+        lineNumber++;
+
+        // Skip empty lines so they do not cause errors.
+        if (trim(line).empty()) {
+            return;
+        }
+
+        vector<string> tokens = split(line, ',');
+
+        // The first line names the columns if its first field is a column
+        // name rather than a course number.
+        if (!sawFirstLine) {
+            sawFirstLine = true;
+            if (catalogColumnForName(tokens[0]) == CatalogColumn::Number) {
+                readHeader(tokens);
+                return;
+            }
+        }
+
+        // A line such as "ALIAS,CS350,MATH350" lists course numbers that
+        // are the same course (cross-listed).
+        if (toUpper(trim(tokens[0])) == "ALIAS") {
+            vector<string> group;
+            for (size_t i = 1; i < tokens.size(); ++i) {
+                string number;
+                if (readCourseNumber(tokens[i], number) && !number.empty()) {
+                    group.push_back(number);
+                }
+            }
+            if (group.size() < 2) {
+                messages << "File format error in " << parsed.fileName
+                         << " on line " << lineNumber
+                         << ": an alias line needs at least two course numbers." << endl;
+                return;
+            }
+            parsed.aliasGroups.push_back(move(group));
+            return;
+        }
+
+        // Each line should have at least a course number and a course title.
+        size_t titleField = find(columns.begin(), columns.end(), CatalogColumn::Title)
+                          - columns.begin();
+        if (tokens.size() <= titleField) {
+            messages << "File format error in " << parsed.fileName
+                     << " on line " << lineNumber
+                     << ": the line ends before the title field." << endl;
+            messages << "Offending line: " << line << endl;
+            // Skip this line and continue with the rest.
+            return;
+        }
+
+        Course course;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            CatalogColumn column = columnAt(i);
+            if (column == CatalogColumn::Number && !readCourseNumber(tokens[i], course.courseNumber)) {
+                return;
+            }
+            if (column == CatalogColumn::Title) {
+                course.courseTitle = trim(tokens[i]);
+            }
+            else if (column == CatalogColumn::Credits) {
+                readCredits(tokens[i], course.creditHours);
+            }
+            else if (column == CatalogColumn::Terms && !parseTermList(tokens[i], course.termsOffered)) {
+                messages << "File format warning in " << parsed.fileName
+                         << " on line " << lineNumber << ": terms '" << trim(tokens[i])
+                         << "' were ignored; use Fall, Spring, Summer or Winter." << endl;
+                course.termsOffered = 0;
+            }
+            else if (column == CatalogColumn::Campus) {
+                course.campus = trim(tokens[i]);
+            }
+        }
+
+        // The prerequisite fields are all required. A field may also be an
+        // expression such as "MATH201 or MATH210"; in that case the whole
+        // list is kept as a rule and every course it names is also listed
+        // in prerequisites.
+        vector<string> rule;
+        bool hasAlternatives = false;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if (columnAt(i) != CatalogColumn::Prerequisites) {
+                continue;
+            }
+            vector<string> fieldRule;
+            if (isPrerequisiteExpression(tokens[i])) {
+                string error;
+                if (!parsePrerequisiteRule(tokens[i], fieldRule, error)) {
+                    messages << "File format warning in " << parsed.fileName
+                             << " on line " << lineNumber << ": prerequisite '"
+                             << trim(tokens[i]) << "' was ignored: " << error << "." << endl;
+                    continue;
+                }
+            }
+            else {
+                string prereqId;
+                if (!readCourseNumber(tokens[i], prereqId) || prereqId.empty()) {
+                    continue;
+                }
+                fieldRule.push_back(prereqId);
+            }
+
+            for (const string& token : fieldRule) {
+                if (token == "OR") {
+                    hasAlternatives = true;
+                }
+                else if (token != "AND"
+                         && find(course.prerequisites.begin(), course.prerequisites.end(), token)
+                                == course.prerequisites.end()) {
+                    course.prerequisites.push_back(token);
+                }
+            }
+            bool joinWithPrevious = !rule.empty();
+            rule.insert(rule.end(), fieldRule.begin(), fieldRule.end());
+            if (joinWithPrevious) {
+                rule.push_back("AND");
+            }
+        }
+        if (hasAlternatives) {
+            course.prerequisiteRule = formatPrerequisiteRule(rule, [](const string& number) {
+                return number;
+            });
+        }
+
+        // Only keep the course if it has both a number and a title.
+        if (!course.courseNumber.empty() && !course.courseTitle.empty()) {
+            parsed.courses.push_back(move(course));
+        }
+        else {
+            messages << "File format warning in " << parsed.fileName
+                     << " on line " << lineNumber
+                     << ": missing course number or title." << endl;
+        }
+    }
+};
+
+// -----------------------------
+// Compressed input
+// -----------------------------
+
+// A small bounded queue that hands blocks of decompressed text from the
+// decompression thread to the parsing thread. The bound keeps memory use
+// flat when decompression runs ahead of parsing.
+class BlockQueue {
+public:
+    explicit BlockQueue(size_t capacity) : maxBlocks(capacity), closed(false) {}
+
+    // Add a block, waiting while the queue is full.
+    void push(string block) {
+        unique_lock<mutex> lock(guard);
+        notFull.wait(lock, [this] { return blocks.size() < maxBlocks; });
+        blocks.push_back(move(block));
+        notEmpty.notify_one();
+    }
+
+    // Mark that no more blocks will be pushed.
+    void close() {
+        lock_guard<mutex> lock(guard);
+        closed = true;
+        notEmpty.notify_all();
+    }
+
+    // Take the next block. Returns false once the queue is closed and empty.
+    bool pop(string& block) {
+        unique_lock<mutex> lock(guard);
+        notEmpty.wait(lock, [this] { return !blocks.empty() || closed; });
+        if (blocks.empty()) {
+            return false;
+        }
+        block = move(blocks.front());
+        blocks.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+private:
+    size_t maxBlocks;
+    bool closed;
+    deque<string> blocks;
+    mutex guard;
+    condition_variable notEmpty;
+    condition_variable notFull;
+};
+
+enum class Compression { None, Gzip, Zstd };
+
+const size_t decompressBlockSize = 256 * 1024;
+
+// Detect compressed input from the magic bytes at the start of the file.
+Compression detectCompression(const string& contents) {
+    if (contents.size() >= 2 && static_cast<unsigned char>(contents[0]) == 0x1f
+        && static_cast<unsigned char>(contents[1]) == 0x8b) {
+        return Compression::Gzip;
+    }
+    if (contents.size() >= 4 && static_cast<unsigned char>(contents[0]) == 0x28
+        && static_cast<unsigned char>(contents[1]) == 0xb5
+        && static_cast<unsigned char>(contents[2]) == 0x2f
+        && static_cast<unsigned char>(contents[3]) == 0xfd) {
+        return Compression::Zstd;
+    }
+    return Compression::None;
+}
+
+// Decompress gzip data block by block into the queue.
+// Returns an empty string on success or an error message.
+string decompressGzip(const string& contents, BlockQueue& queue) {
+#ifdef ABCU_WITH_ZLIB
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 15 + 32 lets zlib detect the gzip header on its own.
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        return "could not start gzip decompression";
+    }
+
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(contents.data()));
+    stream.avail_in = static_cast<uInt>(contents.size());
+
+    int result = Z_OK;
+    while (result != Z_STREAM_END) {
+        string block(decompressBlockSize, '\0');
+        stream.next_out = reinterpret_cast<Bytef*>(&block[0]);
+        stream.avail_out = static_cast<uInt>(block.size());
+
+        result = inflate(&stream, Z_NO_FLUSH);
+        if (result == Z_STREAM_END && stream.avail_in > 0) {
+            // Concatenated gzip members are allowed by the format.
+            inflateReset(&stream);
+            result = Z_OK;
+        }
+        if (result != Z_OK && result != Z_STREAM_END) {
+            inflateEnd(&stream);
+            return "corrupt or truncated gzip data";
+        }
+
+        block.resize(block.size() - stream.avail_out);
+        if (!block.empty()) {
+            queue.push(move(block));
+        }
+        else if (result == Z_OK && stream.avail_in == 0) {
+            inflateEnd(&stream);
+            return "truncated gzip data";
+        }
+    }
+
+    inflateEnd(&stream);
+    return "";
+#else
+    (void)contents;
+    (void)queue;
+    return "gzip input needs a build with zlib (-DABCU_WITH_ZLIB -lz)";
+#endif
+}
+
+// Decompress zstd data block by block into the queue.
+// Returns an empty string on success or an error message.
+string decompressZstd(const string& contents, BlockQueue& queue) {
+#ifdef ABCU_WITH_ZSTD
+    ZSTD_DStream* stream = ZSTD_createDStream();
+    if (stream == nullptr) {
+        return "could not start zstd decompression";
+    }
+    ZSTD_initDStream(stream);
+
+    ZSTD_inBuffer input = { contents.data(), contents.size(), 0 };
+    size_t result = 0;
+    bool outputFull = false;
+    do {
+        string block(decompressBlockSize, '\0');
+        ZSTD_outBuffer output = { &block[0], block.size(), 0 };
+
+        result = ZSTD_decompressStream(stream, &output, &input);
+        if (ZSTD_isError(result)) {
+            string error = ZSTD_getErrorName(result);
+            ZSTD_freeDStream(stream);
+            return "corrupt zstd data: " + error;
+        }
+
+        outputFull = output.pos == output.size;
+        block.resize(output.pos);
+        if (!block.empty()) {
+            queue.push(move(block));
+        }
+    } while (input.pos < input.size || outputFull);
+
+    ZSTD_freeDStream(stream);
+    if (result != 0) {
+        return "truncated zstd data";
+    }
+    return "";
+#else
+    (void)contents;
+    (void)queue;
+    return "zstd input needs a build with libzstd (-DABCU_WITH_ZSTD -lzstd)";
+#endif
+}
+
+// Parse compressed catalog text. One thread decompresses while the calling
+// thread parses the blocks it has already produced, so decompression and
+// parsing overlap instead of running one after the other.
+void parseCompressedCatalog(const string& contents, Compression compression,
+                            ParsedCatalogFile& parsed) {
+    BlockQueue queue(8);
+    string error;
+
+    thread decompressor([&]() {
+        error = compression == Compression::Gzip ? decompressGzip(contents, queue)
+                                                 : decompressZstd(contents, queue);
+        queue.close();
+    });
+
+    CatalogParser parser(parsed);
+    string block;
+    while (queue.pop(block)) {
+        parser.feed(block.data(), block.size());
+    }
+    decompressor.join();
+
+    if (!error.empty()) {
+        parsed.error = error;
+        return;
+    }
+    parser.finish();
+}
+
+// Parse the text of one catalog file into a sorted run of courses.
+void parseCatalogContents(const string& contents, ParsedCatalogFile& parsed) {
+    Compression compression = detectCompression(contents);
+    if (compression != Compression::None) {
+        parseCompressedCatalog(contents, compression, parsed);
+        return;
+    }
+
+    CatalogParser parser(parsed);
+    parser.feed(contents.data(), contents.size());
+    parser.finish();
+}
+
+// Read and hash one catalog file without parsing it.
+void readCatalogFile(ParsedCatalogFile& parsed) {
+    parsed.opened = readFileContents(parsed.fileName, parsed.contents);
+    if (parsed.opened) {
+        parsed.contentHash = hashContents(parsed.contents);
+    }
+}
+
+// Parse a catalog file read by readCatalogFile and release its bytes.
+void parseCatalogFile(ParsedCatalogFile& parsed) {
+    parseCatalogContents(parsed.contents, parsed);
+    string().swap(parsed.contents);
+}
+
+// Merge the sorted runs from several files into one sorted list using a
+// k-way merge. When the same course number appears in more than one file,
+// the file listed last takes precedence, the same way a later line in a
+// single file replaces an earlier one.
+vector<Course> mergeCatalogRuns(vector<ParsedCatalogFile>& files) {
+    struct RunPosition {
+        size_t fileIndex;
+        size_t courseIndex;
+    };
+
+    // The heap pops the smallest course number first and, for equal
+    // numbers, the run from the latest file first.
+    auto comesAfter = [&files](const RunPosition& a, const RunPosition& b) {
+        const string& numberA = files[a.fileIndex].courses[a.courseIndex].courseNumber;
+        const string& numberB = files[b.fileIndex].courses[b.courseIndex].courseNumber;
+        if (numberA != numberB) {
+            return numberA > numberB;
+        }
+        return a.fileIndex < b.fileIndex;
+    };
+    priority_queue<RunPosition, vector<RunPosition>, decltype(comesAfter)> heap(comesAfter);
+
+    size_t totalCourses = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        totalCourses += files[i].courses.size();
+        if (!files[i].courses.empty()) {
+            heap.push({ i, 0 });
+        }
+    }
+
+    vector<Course> merged;
+    merged.reserve(totalCourses);
+    while (!heap.empty()) {
+        RunPosition top = heap.top();
+        heap.pop();
+
+        Course& course = files[top.fileIndex].courses[top.courseIndex];
+        if (merged.empty() || merged.back().courseNumber != course.courseNumber) {
+            merged.push_back(move(course));
+        }
+
+        if (top.courseIndex + 1 < files[top.fileIndex].courses.size()) {
+            heap.push({ top.fileIndex, top.courseIndex + 1 });
+        }
+    }
+    return merged;
+}
+
+// Combine the per-file hashes so that reloading the same set of files
+// can be detected just like reloading a single file.
+uint64_t combineFileHashes(const vector<uint64_t>& fileHashes) {
+    if (fileHashes.size() == 1) {
+        return fileHashes[0];
+    }
+    string bytes(reinterpret_cast<const char*>(fileHashes.data()),
+                 fileHashes.size() * sizeof(uint64_t));
+    return hashContents(bytes);
+}
+
+// Union-find over small integer IDs, used to group cross-listed course
+// numbers into equivalence classes.
+class DisjointSets {
+public:
+    // Add a new single-element set and return its ID.
+    size_t add() {
+        parent.push_back(parent.size());
+        setSize.push_back(1);
+        return parent.size() - 1;
+    }
+
+    // Find the representative of the set containing x, halving the path
+    // on the way so later finds are shorter.
+    size_t find(size_t x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    }
+
+    // Merge the sets containing a and b, attaching the smaller set to the
+    // larger one.
+    void unite(size_t a, size_t b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) {
+            return;
+        }
+        if (setSize[a] < setSize[b]) {
+            swap(a, b);
+        }
+        parent[b] = a;
+        setSize[a] += setSize[b];
+    }
+
+private:
+    vector<size_t> parent;
+    vector<size_t> setSize;
+};
+
+// Link a cross-listed course number to the course that holds its data.
+struct AliasLink {
+    string aliasNumber;
+    string canonicalNumber;
+};
+
+// Group the course numbers named on ALIAS lines into equivalence classes
+// and keep a single course record per class. The canonical number of a
+// class is the lowest number that has its own course line; the records
+// of the other numbers are dropped and their numbers become aliases.
+// mergedCourses must be sorted by course number and stays sorted.
+vector<AliasLink> canonicalizeCrossListings(vector<Course>& mergedCourses,
+                                            const vector<ParsedCatalogFile>& files,
+                                            string& messages) {
+    DisjointSets sets;
+    unordered_map<string, size_t> setIds;
+    vector<string> numbers;
+    auto idFor = [&](const string& number) {
+        auto found = setIds.find(number);
+        if (found != setIds.end()) {
+            return found->second;
+        }
+        size_t id = sets.add();
+        setIds.emplace(number, id);
+        numbers.push_back(number);
+        return id;
+    };
+
+    for (const ParsedCatalogFile& file : files) {
+        for (const vector<string>& group : file.aliasGroups) {
+            size_t first = idFor(group[0]);
+            for (size_t i = 1; i < group.size(); ++i) {
+                sets.unite(first, idFor(group[i]));
+            }
+        }
+    }
+    if (numbers.empty()) {
+        return {};
+    }
+
+    auto findCourse = [&mergedCourses](const string& number) -> Course* {
+        auto found = lower_bound(mergedCourses.begin(), mergedCourses.end(), number,
+                                 [](const Course& course, const string& value) {
+                                     return course.courseNumber < value;
+                                 });
+        if (found == mergedCourses.end() || found->courseNumber != number) {
+            return nullptr;
+        }
+        return &*found;
+    };
+
+    // Pick the canonical number for each class.
+    vector<size_t> canonical(numbers.size(), SIZE_MAX);
+    for (size_t id = 0; id < numbers.size(); ++id) {
+        size_t root = sets.find(id);
+        if (findCourse(numbers[id]) != nullptr
+            && (canonical[root] == SIZE_MAX || numbers[id] < numbers[canonical[root]])) {
+            canonical[root] = id;
+        }
+    }
+
+    vector<AliasLink> links;
+    vector<bool> dropped(mergedCourses.size(), false);
+    for (size_t id = 0; id < numbers.size(); ++id) {
+        size_t root = sets.find(id);
+        if (canonical[root] == SIZE_MAX) {
+            messages += "Alias warning: no course line found for cross-listed number "
+                      + numbers[id] + "; it was ignored.\n";
+            continue;
+        }
+        if (canonical[root] == id) {
+            continue;
+        }
+
+        const string& canonicalNumber = numbers[canonical[root]];
+        Course* duplicate = findCourse(numbers[id]);
+        if (duplicate != nullptr) {
+            dropped[duplicate - mergedCourses.data()] = true;
+        }
+        findCourse(canonicalNumber)->aliases.push_back(numbers[id]);
+        links.push_back({ numbers[id], canonicalNumber });
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < mergedCourses.size(); ++i) {
+        if (!dropped[i]) {
+            if (kept != i) {
+                mergedCourses[kept] = move(mergedCourses[i]);
+            }
+            kept++;
+        }
+    }
+    mergedCourses.resize(kept);
+
+    for (Course& course : mergedCourses) {
+        sort(course.aliases.begin(), course.aliases.end());
+    }
+    return links;
+}
+
+// Turn the text the user typed into a list of catalog files. Several
+// files can be separated with ';', and a folder expands to every regular
+// file inside it in name order.
+vector<string> expandCatalogPaths(const string& input) {
+    vector<string> paths;
+    for (const string& part : split(input, ';')) {
+        string path = trim(part);
+        if (path.empty()) {
+            continue;
+        }
+
+        error_code error;
+        if (filesystem::is_directory(path, error)) {
+            vector<string> folderFiles;
+            for (const auto& entry : filesystem::directory_iterator(path, error)) {
+                if (entry.is_regular_file(error)) {
+                    folderFiles.push_back(entry.path().string());
+                }
+            }
+            sort(folderFiles.begin(), folderFiles.end());
+            paths.insert(paths.end(), folderFiles.begin(), folderFiles.end());
+        }
+        else {
+            paths.push_back(path);
+        }
+    }
+    return paths;
+}
+
+// Call work on every file, using up to one thread per core. Each worker
+// takes the next file until none are left.
+void forEachCatalogFile(vector<ParsedCatalogFile>& files, void (*work)(ParsedCatalogFile&)) {
+    atomic<size_t> nextFile(0);
+    auto fileWorker = [&files, &nextFile, work]() {
+        for (size_t i = nextFile++; i < files.size(); i = nextFile++) {
+            work(files[i]);
+        }
+    };
+
+    size_t workerCount = min<size_t>(files.size(), max(1u, thread::hardware_concurrency()));
+    vector<thread> workers;
+    for (size_t i = 1; i < workerCount; ++i) {
+        workers.emplace_back(fileWorker);
+    }
+    fileWorker();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// Read and hash several catalog files on separate threads, without
+// parsing them, and combine their hashes. Returns false after reporting
+// the problem if there are no files or one could not be read.
+bool readCatalogFiles(const vector<string>& fileNames, vector<ParsedCatalogFile>& files,
+                      uint64_t& contentHash) {
+    if (fileNames.empty()) {
+        cout << "No course data files found." << endl;
+        return false;
+    }
+
+    files.assign(fileNames.size(), ParsedCatalogFile());
+    for (size_t i = 0; i < fileNames.size(); ++i) {
+        files[i].fileName = fileNames[i];
+    }
+    forEachCatalogFile(files, readCatalogFile);
+
+    vector<uint64_t> fileHashes;
+    for (const ParsedCatalogFile& file : files) {
+        if (!file.opened) {
+            cout << "Error opening file: " << file.fileName << endl;
+            return false;
+        }
+        fileHashes.push_back(file.contentHash);
+    }
+    contentHash = combineFileHashes(fileHashes);
+    return true;
+}
+
+// Parse catalog files already read by readCatalogFiles and store their
+// courses in the tree. The files are parsed on separate threads and then
+// merged. Returns true if the load is successful.
+bool loadReadCatalogFiles(vector<ParsedCatalogFile>& files, uint64_t contentHash, CourseBST& tree) {
+    // Users often reload the same file. If the contents match what is
+    // already in the tree, there is nothing to parse or rebuild.
+    if (!tree.isEmpty() && tree.getSourceHash() == contentHash) {
+        cout << "Course data is unchanged; keeping the loaded courses." << endl;
+        return true;
+    }
+
+    forEachCatalogFile(files, parseCatalogFile);
+    for (const ParsedCatalogFile& file : files) {
+        if (!file.error.empty()) {
+            cout << "Error reading file " << file.fileName << ": " << file.error << endl;
+            return false;
+        }
+    }
+
+    for (const ParsedCatalogFile& file : files) {
+        cout << file.messages;
+    }
+
+    vector<Course> merged = mergeCatalogRuns(files);
+    string aliasMessages;
+    vector<AliasLink> aliasLinks = canonicalizeCrossListings(merged, files, aliasMessages);
+    cout << aliasMessages;
+
+    // Clear any existing data before loading new courses.
+    tree.clear();
+    tree.buildFromSorted(move(merged));
+    for (const AliasLink& link : aliasLinks) {
+        tree.addAlias(link.aliasNumber, link.canonicalNumber);
+    }
+    tree.setSourceHash(contentHash);
+
+    for (const ParsedCatalogFile& file : files) {
+        cout << "Courses successfully loaded from file: " << file.fileName << endl;
+    }
+    return true;
+}
+
+// Load course data from several CSV files and store it in the tree. The
+// files are hashed before they are parsed, so reloading unchanged files
+// costs only the read. Returns true if the load is successful.
+bool loadCoursesFromFiles(const vector<string>& fileNames, CourseBST& tree) {
+    vector<ParsedCatalogFile> files;
+    uint64_t contentHash;
+    return readCatalogFiles(fileNames, files, contentHash)
+        && loadReadCatalogFiles(files, contentHash, tree);
+}
+
+// Load course data from a CSV file and store it in the tree. The name may
+// also list several files separated by ';' or name a folder of files.
+// Returns true if the load is successful.
+bool loadCoursesFromFile(const string& fileName, CourseBST& tree) {
+    return loadCoursesFromFiles(expandCatalogPaths(fileName), tree);
+}
+
+// -----------------------------
+// Embedded catalog
+// -----------------------------
+
+// A kiosk that ships one fixed catalog can have it compiled into the
+// program instead of reading a course file at startup:
+//
+//   ProjectTwo --embed courses.csv kiosk_catalog.h
+//   g++ -std=c++17 -DABCU_EMBEDDED_CATALOG='"kiosk_catalog.h"' ProjectTwo.cpp
+//
+// The generated header holds the courses as constant arrays sorted by
+// course number, so startup builds the tree straight from them with no
+// file I/O and no parsing. Option 1 can still load course files over it.
+
+// One course in a generated catalog header. Its prerequisites are
+// embeddedPrerequisites[prereqStart] up to
+// embeddedPrerequisites[prereqStart + prereqCount - 1].
+struct EmbeddedCourse {
+    const char* number;
+    const char* title;
+    uint32_t prereqStart;
+    uint32_t prereqCount;
+    const char* prerequisiteRule;
+    uint8_t creditHours;
+    uint8_t termsOffered;
+    const char* campus;
+};
+
+// A cross-listed number and the course number that holds its data.
+struct EmbeddedAlias {
+    const char* aliasNumber;
+    const char* canonicalNumber;
+};
+
+// True if the courses are in strictly increasing course number order,
+// which buildFromSorted needs. Checked when the program is compiled.
+template <size_t count>
+constexpr bool isSortedByNumber(const EmbeddedCourse (&courses)[count]) {
+    for (size_t i = 1; i < count; ++i) {
+        if (!(string_view(courses[i - 1].number) < string_view(courses[i].number))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef ABCU_EMBEDDED_CATALOG
+#include ABCU_EMBEDDED_CATALOG
+
+static_assert(isSortedByNumber(embeddedCourses),
+              "the embedded courses must be sorted by course number");
+
+// Build the tree from the catalog compiled into the program.
+void loadEmbeddedCatalog(CourseBST& tree) {
+    vector<Course> courses(sizeof(embeddedCourses) / sizeof(embeddedCourses[0]));
+    for (size_t i = 0; i < courses.size(); ++i) {
+        const EmbeddedCourse& embedded = embeddedCourses[i];
+        courses[i].courseNumber = embedded.number;
+        courses[i].courseTitle = embedded.title;
+        courses[i].prerequisites.assign(embeddedPrerequisites + embedded.prereqStart,
+                                        embeddedPrerequisites + embedded.prereqStart
+                                            + embedded.prereqCount);
+        courses[i].prerequisiteRule = embedded.prerequisiteRule;
+        courses[i].creditHours = embedded.creditHours;
+        courses[i].termsOffered = embedded.termsOffered;
+        courses[i].campus = embedded.campus;
+    }
+    for (const EmbeddedAlias& alias : embeddedAliases) {
+        if (alias.aliasNumber[0] == '\0') {
+            continue;
+        }
+        auto course = lower_bound(courses.begin(), courses.end(), alias.canonicalNumber,
+                                  [](const Course& c, const char* number) {
+                                      return c.courseNumber < number;
+                                  });
+        course->aliases.push_back(alias.aliasNumber);
+    }
+
+    tree.buildFromSorted(move(courses));
+    for (const EmbeddedAlias& alias : embeddedAliases) {
+        if (alias.aliasNumber[0] != '\0') {
+            tree.addAlias(alias.aliasNumber, alias.canonicalNumber);
+        }
+    }
+    tree.setSourceHash(embeddedSourceHash);
+}
+#endif
+
+// Write a string as a C++ string literal. Anything other than printable
+// ASCII is written as an octal escape, which cannot run into the
+// characters after it the way a hex escape can.
+void writeStringLiteral(ostream& out, const string& text) {
+    out << '"';
+    for (char c : text) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        }
+        else if (u < 0x20 || u >= 0x7F) {
+            out << '\\' << static_cast<char>('0' + (u >> 6)) << static_cast<char>('0' + ((u >> 3) & 7))
+                << static_cast<char>('0' + (u & 7));
+        }
+        else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// Write the loaded catalog as a header for ABCU_EMBEDDED_CATALOG.
+// Returns false if the file could not be written.
+bool writeEmbeddedCatalog(CourseBST& tree, const string& sourceNames, const string& path) {
+    ofstream out(path);
+    if (!out.is_open()) {
+        return false;
+    }
+
+    vector<Course*> courses;
+    tree.collectInOrder(courses);
+
+    out << "// Generated by ProjectTwo --embed from " << sourceNames << "." << endl;
+    out << "// Do not edit; generate it again from the course files instead." << endl;
+    out << endl;
+    out << "constexpr uint64_t embeddedSourceHash = " << tree.getSourceHash() << "ULL;" << endl;
+    out << endl;
+
+    // Arrays cannot be empty, so an empty list gets one blank entry that
+    // the loader skips.
+    out << "constexpr const char* embeddedPrerequisites[] = {" << endl;
+    size_t prereqTotal = 0;
+    for (const Course* course : courses) {
+        for (const string& prereq : course->prerequisites) {
+            out << "    ";
+            writeStringLiteral(out, prereq);
+            out << "," << endl;
+            prereqTotal++;
+        }
+    }
+    if (prereqTotal == 0) {
+        out << "    \"\"," << endl;
+    }
+    out << "};" << endl;
+    out << endl;
+
+    out << "constexpr EmbeddedCourse embeddedCourses[] = {" << endl;
+    size_t prereqStart = 0;
+    for (const Course* course : courses) {
+        out << "    { ";
+        writeStringLiteral(out, course->courseNumber);
+        out << ", ";
+        writeStringLiteral(out, course->courseTitle);
+        out << ", " << prereqStart << ", " << course->prerequisites.size() << ", ";
+        writeStringLiteral(out, course->prerequisiteRule);
+        out << ", " << static_cast<int>(course->creditHours) << ", "
+            << static_cast<int>(course->termsOffered) << ", ";
+        writeStringLiteral(out, course->campus);
+        out << " }," << endl;
+        prereqStart += course->prerequisites.size();
+    }
+    out << "};" << endl;
+    out << endl;
+
+    out << "constexpr EmbeddedAlias embeddedAliases[] = {" << endl;
+    size_t aliasTotal = 0;
+    for (const Course* course : courses) {
+        for (const string& alias : course->aliases) {
+            out << "    { ";
+            writeStringLiteral(out, alias);
+            out << ", ";
+            writeStringLiteral(out, course->courseNumber);
+            out << " }," << endl;
+            aliasTotal++;
+        }
+    }
+    if (aliasTotal == 0) {
+        out << "    { \"\", \"\" }," << endl;
+    }
+    out << "};" << endl;
+    return static_cast<bool>(out);
+}
+
+// -----------------------------
+// Catalog edits and journal
+// -----------------------------
+
+// Courses can be added, changed and removed while the program runs. So
+// that edits survive a restart without parsing the course files again,
+// they are kept in two files next to the first course file:
+//   <file>.snapshot   every course as of some edit, in a binary format
+//   <file>.journal    each edit made since then, appended as it happens
+// Every edit has a sequence number and the snapshot records the last one
+// it contains, so on startup only the journal records after it are
+// replayed. Once the journal grows long it is renamed to <file>.journal.old,
+// a new snapshot is written on a background thread, and the old journal is
+// deleted. A crash at any point leaves files that load correctly.
+// Numbers are stored in the machine's byte order.
+
+enum class EditKind : uint8_t {
+    Insert = 1,
+    Update = 2,
+    Remove = 3
+};
+
+// One change to the catalog. Remove only uses course.courseNumber.
+struct CatalogEdit {
+    uint64_t sequence = 0;
+    EditKind kind = EditKind::Insert;
+    Course course;
+};
+
+// Append fixed-size values and length-prefixed strings to a byte buffer.
+void appendUint32(string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendUint64(string& out, uint64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendString(string& out, const string& value) {
+    appendUint32(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+// Reads values written by the append functions. Every read checks the
+// remaining length, so a truncated or damaged buffer fails cleanly.
+struct ByteReader {
+    const char* position;
+    const char* end;
+
+    bool readUint32(uint32_t& value) {
+        if (end - position < static_cast<ptrdiff_t>(sizeof(value))) {
+            return false;
+        }
+        memcpy(&value, position, sizeof(value));
+        position += sizeof(value);
+        return true;
+    }
+
+    bool readUint64(uint64_t& value) {
+        if (end - position < static_cast<ptrdiff_t>(sizeof(value))) {
+            return false;
+        }
+        memcpy(&value, position, sizeof(value));
+        position += sizeof(value);
+        return true;
+    }
+
+    bool readString(string& value) {
+        uint32_t length;
+        if (!readUint32(length) || static_cast<size_t>(end - position) < length) {
+            return false;
+        }
+        value.assign(position, length);
+        position += length;
+        return true;
+    }
+
+    bool readStringList(vector<string>& values) {
+        uint32_t count;
+        if (!readUint32(count)) {
+            return false;
+        }
+        values.clear();
+        for (uint32_t i = 0; i < count; ++i) {
+            values.emplace_back();
+            if (!readString(values.back())) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+void encodeCourse(string& out, const Course& course) {
+    appendString(out, course.courseNumber);
+    appendString(out, course.courseTitle);
+    appendUint32(out, static_cast<uint32_t>(course.prerequisites.size()));
+    for (const string& prereq : course.prerequisites) {
+        appendString(out, prereq);
+    }
+    appendUint32(out, static_cast<uint32_t>(course.aliases.size()));
+    for (const string& alias : course.aliases) {
+        appendString(out, alias);
+    }
+    appendString(out, course.prerequisiteRule);
+    out += static_cast<char>(course.creditHours);
+    out += static_cast<char>(course.termsOffered);
+    appendString(out, course.campus);
+}
+
+// Read a course up to its prerequisite rule, which is where courses
+// written before credits, terms and campus were added end.
+bool decodeCourse(ByteReader& reader, Course& course) {
+    return reader.readString(course.courseNumber)
+        && reader.readString(course.courseTitle)
+        && reader.readStringList(course.prerequisites)
+        && reader.readStringList(course.aliases)
+        && reader.readString(course.prerequisiteRule);
+}
+
+// Read the credits, terms and campus that follow the prerequisite rule.
+bool decodeCourseColumns(ByteReader& reader, Course& course) {
+    if (reader.end - reader.position < 2) {
+        return false;
+    }
+    course.creditHours = static_cast<uint8_t>(*reader.position++);
+    course.termsOffered = static_cast<uint8_t>(*reader.position++);
+    return reader.readString(course.campus);
+}
+
+// Flush a file and ask the operating system to put it on disk.
+bool syncFile(FILE* file) {
+    if (fflush(file) != 0) {
+        return false;
+    }
+#if defined(__unix__) || defined(__APPLE__)
+    return fsync(fileno(file)) == 0;
+#else
+    return true;
+#endif
+}
+
+// Replace a file so that readers see either the old contents or the new,
+// never a partial file: write a temporary file, sync it, then rename it.
+bool replaceFileContents(const string& path, const string& contents) {
+    string tempPath = path + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size()
+                && syncFile(file);
+    written = fclose(file) == 0 && written;
+
+    error_code error;
+    if (written) {
+        filesystem::rename(tempPath, path, error);
+    }
+    if (!written || error) {
+        filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+const char snapshotMagic[] = "ABCUSNP2";
+const char oldSnapshotMagic[] = "ABCUSNP1";   // courses without credits, terms and campus
+
+// Write every course to a snapshot file, along with the hash of the
+// course files the catalog came from and the last edit it includes. The
+// courses must be sorted by course number. A checksum of the whole file
+// is stored at the end.
+bool writeSnapshot(const string& path, uint64_t baseHash, uint64_t sequence,
+                   const vector<Course>& courses) {
+    string contents(snapshotMagic, 8);
+    appendUint64(contents, baseHash);
+    appendUint64(contents, sequence);
+    appendUint64(contents, courses.size());
+    for (const Course& course : courses) {
+        encodeCourse(contents, course);
+    }
+    appendUint64(contents, hashContents(contents));
+    return replaceFileContents(path, contents);
+}
+
+// Read a snapshot written by writeSnapshot.
+bool readSnapshot(const string& path, uint64_t& baseHash, uint64_t& sequence,
+                  vector<Course>& courses, string& error) {
+    string contents;
+    if (!readFileContents(path, contents)) {
+        error = "the file could not be read";
+        return false;
+    }
+    bool oldFormat = contents.size() >= 8 && contents.compare(0, 8, oldSnapshotMagic, 8) == 0;
+    if (contents.size() < 8 + 4 * sizeof(uint64_t)
+        || (contents.compare(0, 8, snapshotMagic, 8) != 0 && !oldFormat)) {
+        error = "not a course snapshot";
+        return false;
+    }
+
+    uint64_t storedChecksum;
+    memcpy(&storedChecksum, contents.data() + contents.size() - 8, 8);
+    contents.resize(contents.size() - 8);
+    if (hashContents(contents) != storedChecksum) {
+        error = "the checksum does not match";
+        return false;
+    }
+
+    ByteReader reader{ contents.data() + 8, contents.data() + contents.size() };
+    uint64_t count;
+    if (!reader.readUint64(baseHash) || !reader.readUint64(sequence) || !reader.readUint64(count)) {
+        error = "the header is damaged";
+        return false;
+    }
+    courses.clear();
+    courses.reserve(static_cast<size_t>(min<uint64_t>(count, contents.size())));
+    for (uint64_t i = 0; i < count; ++i) {
+        courses.emplace_back();
+        if (!decodeCourse(reader, courses.back())
+            || (!oldFormat && !decodeCourseColumns(reader, courses.back()))) {
+            error = "course " + to_string(i + 1) + " is damaged";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Encode an edit as a journal record: the payload length, a checksum of
+// the payload, then the sequence number, kind and course.
+string encodeJournalRecord(const CatalogEdit& edit) {
+    string payload;
+    appendUint64(payload, edit.sequence);
+    payload += static_cast<char>(edit.kind);
+    encodeCourse(payload, edit.course);
+
+    string record;
+    appendUint32(record, static_cast<uint32_t>(payload.size()));
+    appendUint32(record, static_cast<uint32_t>(hashContents(payload)));
+    record += payload;
+    return record;
+}
+
+// Read the records of a journal file that come after afterSequence.
+// Reading stops at the first record that is cut short or fails its
+// checksum, which is where a crash during a write leaves the file.
+// validBytes is set to the length of the intact part.
+bool readJournal(const string& path, uint64_t afterSequence, vector<CatalogEdit>& edits,
+                 uint64_t& validBytes) {
+    string contents;
+    if (!readFileContents(path, contents)) {
+        return false;
+    }
+
+    ByteReader reader{ contents.data(), contents.data() + contents.size() };
+    validBytes = 0;
+    while (true) {
+        uint32_t length;
+        uint32_t checksum;
+        if (!reader.readUint32(length) || !reader.readUint32(checksum)
+            || static_cast<size_t>(reader.end - reader.position) < length) {
+            break;
+        }
+        string payload(reader.position, length);
+        reader.position += length;
+        if (static_cast<uint32_t>(hashContents(payload)) != checksum) {
+            break;
+        }
+
+        CatalogEdit edit;
+        ByteReader payloadReader{ payload.data(), payload.data() + payload.size() };
+        if (!payloadReader.readUint64(edit.sequence) || payloadReader.position == payloadReader.end) {
+            break;
+        }
+        edit.kind = static_cast<EditKind>(*payloadReader.position++);
+        if (!decodeCourse(payloadReader, edit.course)) {
+            break;
+        }
+        // Records written before courses had credits, terms and a campus
+        // end here.
+        if (payloadReader.position != payloadReader.end
+            && !decodeCourseColumns(payloadReader, edit.course)) {
+            break;
+        }
+
+        validBytes = static_cast<uint64_t>(reader.position - contents.data());
+        if (edit.sequence > afterSequence) {
+            edits.push_back(move(edit));
+        }
+    }
+    return true;
+}
+
+// An append-only journal file. append() returns once the record is on
+// disk. A writer thread does the writing: records from callers that
+// arrive while a write is in progress are written and synced together by
+// the next write (group commit), so threads appending at the same time
+// share one sync instead of paying for one each.
+class CatalogJournal {
+public:
+    ~CatalogJournal() {
+        close();
+    }
+
+    bool open(const string& path) {
+        close();
+        file = fopen(path.c_str(), "ab");
+        if (file == nullptr) {
+            return false;
+        }
+        stopping = false;
+        failed = false;
+        nextBatch = 1;
+        durableBatch = 0;
+        writer = thread(&CatalogJournal::writeLoop, this);
+        return true;
+    }
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    // Append an encoded record and wait until it has been synced. Returns
+    // false if the journal is closed or the write failed.
+    bool append(const string& record) {
+        unique_lock<mutex> lock(guard);
+        if (file == nullptr || failed) {
+            return false;
+        }
+        pending += record;
+        uint64_t batch = nextBatch;
+        workReady.notify_one();
+        batchDone.wait(lock, [&] { return durableBatch >= batch || failed; });
+        return durableBatch >= batch;
+    }
+
+    // Finish any pending writes and close the file.
+    void close() {
+        if (file == nullptr) {
+            return;
+        }
+        {
+            lock_guard<mutex> lock(guard);
+            stopping = true;
+        }
+        workReady.notify_one();
+        writer.join();
+        fclose(file);
+        file = nullptr;
+    }
+
+    // Number of write-and-sync batches since the journal was opened.
+    uint64_t syncCount() const {
+        lock_guard<mutex> lock(guard);
+        return durableBatch;
+    }
+
+private:
+    FILE* file = nullptr;
+    thread writer;
+    mutable mutex guard;
+    condition_variable workReady;
+    condition_variable batchDone;
+    string pending;           // records waiting for the next batch
+    uint64_t nextBatch = 1;   // batch the records in pending will go out in
+    uint64_t durableBatch = 0;
+    bool stopping = false;
+    bool failed = false;
+
+    void writeLoop() {
+        unique_lock<mutex> lock(guard);
+        while (true) {
+            workReady.wait(lock, [&] { return !pending.empty() || stopping; });
+            if (pending.empty()) {
+                return;
+            }
+
+            string batchData;
+            batchData.swap(pending);
+            uint64_t batch = nextBatch++;
+            lock.unlock();
+
+            bool written = !failed
+                        && fwrite(batchData.data(), 1, batchData.size(), file) == batchData.size()
+                        && syncFile(file);
+
+            lock.lock();
+            if (written) {
+                durableBatch = batch;
+            }
+            else {
+                failed = true;
+            }
+            batchDone.notify_all();
+        }
+    }
+};
+
+// The hash that identifies the catalog after a number of edits. It is
+// used as the tree's source hash so the catalog index notices edits.
+uint64_t editStateHash(uint64_t baseHash, uint64_t sequence) {
+    if (sequence == 0) {
+        return baseHash;
+    }
+    string bytes;
+    appendUint64(bytes, baseHash);
+    appendUint64(bytes, sequence);
+    return hashContents(bytes);
+}
+
+// Parse one catalog line, such as "CSCI400,Large Software Development,CSCI301",
+// into a course. Warnings go to messages.
+bool parseCourseLine(const string& line, Course& course, string& messages) {
+    ParsedCatalogFile parsed;
+    parsed.fileName = "the entered course";
+    CatalogParser parser(parsed);
+    parser.feed(line.data(), line.size());
+    parser.finish();
+    messages = parsed.messages;
+    if (parsed.courses.size() != 1) {
+        return false;
+    }
+    course = move(parsed.courses[0]);
+    return true;
+}
+
+// Check that an edit can be applied to the tree. An update through a
+// cross-listed number is changed to update the course it refers to. Every
+// prerequisite of an added or updated course must already be in the
+// catalog and must not be the course itself, since the edit is saved as
+// is and never goes through the file loader again.
+bool validateCatalogEdit(CourseBST& tree, CatalogEdit& edit, string& error) {
+    const string& number = edit.course.courseNumber;
+    if (number.empty()) {
+        error = "The course number cannot be empty.";
+        return false;
+    }
+
+    Course* existing = tree.search(number);
+    if (edit.kind == EditKind::Insert) {
+        if (existing != nullptr) {
+            error = "Course " + number + " already exists.";
+            return false;
+        }
+    }
+    else if (existing == nullptr) {
+        error = "Course " + number + " not found.";
+        return false;
+    }
+    else if (existing->courseNumber != number) {
+        if (edit.kind == EditKind::Remove) {
+            error = number + " is cross-listed with " + existing->courseNumber
+                  + "; remove " + existing->courseNumber + " instead.";
+            return false;
+        }
+        edit.course.courseNumber = existing->courseNumber;
+    }
+
+    if (edit.kind != EditKind::Remove && edit.course.courseTitle.empty()) {
+        error = "The course title cannot be empty.";
+        return false;
+    }
+
+    if (edit.kind != EditKind::Remove) {
+        const vector<string>& aliases = edit.course.aliases;
+        for (const string& prereq : edit.course.prerequisites) {
+            Course* prereqCourse = tree.search(prereq);
+            bool isSelf = prereq == edit.course.courseNumber
+                       || find(aliases.begin(), aliases.end(), prereq) != aliases.end()
+                       || (prereqCourse != nullptr && prereqCourse == existing);
+            if (isSelf) {
+                error = "Course " + edit.course.courseNumber + " cannot be its own prerequisite.";
+                return false;
+            }
+            if (prereqCourse == nullptr) {
+                error = "Prerequisite " + prereq + ": course not found in data.";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Apply an edit that validateCatalogEdit accepted.
+void applyCatalogEdit(CourseBST& tree, const CatalogEdit& edit) {
+    if (edit.kind == EditKind::Remove) {
+        tree.remove(edit.course.courseNumber);
+    }
+    else {
+        tree.insert(edit.course);
+    }
+}
+
+// Keeps the snapshot and journal for the loaded catalog. Loading does not
+// create any files; the first edit writes a snapshot of the catalog as
+// loaded and opens the journal.
+class CatalogStore {
+public:
+    ~CatalogStore() {
+        close();
+    }
+
+    // Journal records written before the journal is compacted into a new
+    // snapshot.
+    size_t compactAfter = 1000;
+
+    // Load the catalog from the snapshot and journal if they were made
+    // from the same course files, and from the course files otherwise.
+    // Returns true if the load is successful.
+    bool load(const vector<string>& fileNames, CourseBST& tree) {
+        // The files are read once; their bytes are parsed below only if
+        // the snapshot does not already hold them.
+        vector<ParsedCatalogFile> files;
+        uint64_t fileHash;
+        if (!readCatalogFiles(fileNames, files, fileHash)) {
+            return false;
+        }
+
+        if (fileNames[0] + ".snapshot" == snapshotPath && fileHash == baseHash
+            && !tree.isEmpty()) {
+            cout << "Course data is unchanged; keeping the loaded courses." << endl;
+            return true;
+        }
+
+        close();
+        snapshotPath = fileNames[0] + ".snapshot";
+        journalPath = fileNames[0] + ".journal";
+        oldJournalPath = journalPath + ".old";
+        baseHash = fileHash;
+        sequence = 0;
+        journalRecords = 0;
+        journalValidBytes = 0;
+        hasSnapshot = false;
+
+        error_code error;
+        if (filesystem::exists(snapshotPath, error)) {
+            uint64_t savedHash;
+            uint64_t savedSequence;
+            vector<Course> courses;
+            string readError;
+            if (!readSnapshot(snapshotPath, savedHash, savedSequence, courses, readError)) {
+                cout << "Error reading " << snapshotPath << ": " << readError << "." << endl;
+            }
+            else if (savedHash != fileHash) {
+                cout << "The course files have changed since the saved edits were made." << endl;
+            }
+            else {
+                restore(tree, move(courses), savedSequence);
+                return true;
+            }
+            setAsideSavedEdits();
+        }
+        else if (filesystem::exists(journalPath, error)
+                 || filesystem::exists(oldJournalPath, error)) {
+            cout << "The saved edits have no matching snapshot." << endl;
+            setAsideSavedEdits();
+        }
+
+        return loadReadCatalogFiles(files, fileHash, tree);
+    }
+
+    // Validate an edit, write it to the journal, and apply it to the tree.
+    // On failure the tree is unchanged and error explains why.
+    bool applyEdit(CourseBST& tree, CatalogEdit& edit, string& error) {
+        if (snapshotPath.empty()) {
+            error = "No course files are loaded.";
+            return false;
+        }
+        if (!validateCatalogEdit(tree, edit, error)) {
+            return false;
+        }
+
+        if (!journal.isOpen()) {
+            if (!hasSnapshot) {
+                if (!writeSnapshot(snapshotPath, baseHash, sequence, copyCourses(tree))) {
+                    error = "Could not write " + snapshotPath + ".";
+                    return false;
+                }
+                hasSnapshot = true;
+            }
+
+            // Drop a record left half-written by a crash before appending.
+            error_code sizeError;
+            if (filesystem::exists(journalPath, sizeError)
+                && filesystem::file_size(journalPath, sizeError) > journalValidBytes) {
+                filesystem::resize_file(journalPath, journalValidBytes, sizeError);
+            }
+            if (!journal.open(journalPath)) {
+                error = "Could not open " + journalPath + ".";
+                return false;
+            }
+        }
+
+        edit.sequence = sequence + 1;
+        if (!journal.append(encodeJournalRecord(edit))) {
+            error = "Could not write to " + journalPath + ".";
+            return false;
+        }
+        sequence = edit.sequence;
+        applyCatalogEdit(tree, edit);
+        tree.setSourceHash(editStateHash(baseHash, sequence));
+
+        if (++journalRecords >= compactAfter) {
+            startCompaction(tree);
+        }
+        return true;
+    }
+
+    // Wait for a running compaction and close the journal.
+    void close() {
+        if (compactor.joinable()) {
+            compactor.join();
+        }
+        journal.close();
+    }
+
+private:
+    string snapshotPath;
+    string journalPath;
+    string oldJournalPath;
+    uint64_t baseHash = 0;        // hash of the course files
+    uint64_t sequence = 0;        // last edit applied
+    uint64_t journalValidBytes = 0;
+    size_t journalRecords = 0;    // records in the current journal file
+    bool hasSnapshot = false;
+    CatalogJournal journal;
+    thread compactor;
+    atomic<bool> compacting{ false };
+
+    static vector<Course> copyCourses(CourseBST& tree) {
+        vector<Course*> current;
+        tree.collectInOrder(current);
+        vector<Course> courses;
+        courses.reserve(current.size());
+        for (Course* course : current) {
+            courses.push_back(*course);
+        }
+        return courses;
+    }
+
+    // Build the tree from a snapshot and replay the journal records that
+    // came after it.
+    void restore(CourseBST& tree, vector<Course> courses, uint64_t snapshotSequence) {
+        size_t courseCount = courses.size();
+        vector<AliasLink> links;
+        for (const Course& course : courses) {
+            for (const string& alias : course.aliases) {
+                links.push_back({ alias, course.courseNumber });
+            }
+        }
+        tree.clear();
+        tree.buildFromSorted(move(courses));
+        for (const AliasLink& link : links) {
+            tree.addAlias(link.aliasNumber, link.canonicalNumber);
+        }
+        sequence = snapshotSequence;
+        hasSnapshot = true;
+
+        // The old journal only exists if a compaction did not finish.
+        size_t replayed = 0;
+        error_code error;
+        for (const string& path : { oldJournalPath, journalPath }) {
+            if (!filesystem::exists(path, error)) {
+                continue;
+            }
+            vector<CatalogEdit> edits;
+            uint64_t validBytes = 0;
+            if (!readJournal(path, sequence, edits, validBytes)) {
+                cout << "Error reading " << path << "; its edits were not applied." << endl;
+                continue;
+            }
+            for (CatalogEdit& edit : edits) {
+                string editError;
+                if (validateCatalogEdit(tree, edit, editError)) {
+                    applyCatalogEdit(tree, edit);
+                }
+                else {
+                    cout << "Saved edit " << edit.sequence << " was skipped: " << editError << endl;
+                }
+                sequence = edit.sequence;
+                replayed++;
+            }
+            if (path == journalPath) {
+                journalValidBytes = validBytes;
+                journalRecords = edits.size();
+            }
+        }
+        tree.setSourceHash(editStateHash(baseHash, sequence));
+
+        cout << "Courses restored from " << snapshotPath << " (" << courseCount
+             << " courses); " << replayed << " saved edits replayed." << endl;
+    }
+
+    // Move saved edits that no longer apply out of the way, so the next
+    // edit starts a fresh snapshot and journal.
+    void setAsideSavedEdits() {
+        error_code error;
+        for (const string& path : { snapshotPath, journalPath, oldJournalPath }) {
+            if (filesystem::exists(path, error)) {
+                filesystem::rename(path, path + ".stale", error);
+                cout << "Saved edits were not applied; " << path << " was renamed to "
+                     << path << ".stale." << endl;
+            }
+        }
+    }
+
+    // Start a new journal and write a snapshot of the current courses on a
+    // background thread. The courses are copied first so edits can go on
+    // while the snapshot is written. If an earlier compaction failed, its
+    // old journal is still there; the journal is then not rotated again,
+    // and the new snapshot covers both files.
+    void startCompaction(CourseBST& tree) {
+        if (compacting) {
+            return;
+        }
+        if (compactor.joinable()) {
+            compactor.join();
+        }
+
+        error_code error;
+        if (!filesystem::exists(oldJournalPath, error)) {
+            journal.close();
+            filesystem::rename(journalPath, oldJournalPath, error);
+            journal.open(journalPath);
+            journalValidBytes = 0;
+            if (error) {
+                return;
+            }
+        }
+        journalRecords = 0;
+
+        compacting = true;
+        compactor = thread([this, courses = copyCourses(tree), hash = baseHash,
+                            lastSequence = sequence]() {
+            if (writeSnapshot(snapshotPath, hash, lastSequence, courses)) {
+                error_code removeError;
+                filesystem::remove(oldJournalPath, removeError);
+            }
+            compacting = false;
+        });
+    }
+};
+
+// -----------------------------
+// Disk catalog archive
+// -----------------------------
+
+// An archive of every course ever offered can be larger than memory, so it
+// is kept on disk as a B+ tree of fixed-size pages keyed by course number
+// and read a page at a time through a small cache. The file layout is:
+//
+//   page 0     header: magic, page size, root page, tree height, first
+//              leaf page and record count
+//   leaf       8-byte page header, then a uint16 offset per course and the
+//              courses themselves, each a uint16 length and an encoded
+//              course, packed from the end of the page
+//   inner      8-byte page header, then count child page numbers and
+//              count - 1 separator keys of 16 bytes (a length byte and up
+//              to 15 characters); child i holds the numbers from key i - 1
+//              up to but not including key i
+//
+// A page header is a kind byte, a spare byte, a uint16 count and, for
+// leaves, the page number of the next leaf (0 after the last). The tree is
+// written once, bottom up, from courses in course number order.
+
+const char archiveMagic[] = "ABCUBPT1";
+constexpr uint32_t archivePageSize = 4096;
+constexpr uint32_t archiveHeaderSize = 8;
+constexpr uint32_t archiveKeySize = 16;
+constexpr uint32_t archiveFanout = (archivePageSize - archiveHeaderSize) / (4 + archiveKeySize);
+constexpr uint8_t archiveLeaf = 1;
+constexpr uint8_t archiveInner = 2;
+
+// Writes an archive from courses added in increasing course number order.
+// A course with the same number as the one before it replaces it, the
+// same as a repeated line in a course file. Only the leaf being filled
+// and the first key of each page are kept in memory, so the input can be
+// larger than memory. The archive is written to a temporary file and
+// renamed into place by finish().
+class ArchiveBuilder {
+public:
+    ~ArchiveBuilder() {
+        if (file != nullptr) {
+            fclose(file);
+            error_code removeError;
+            filesystem::remove(tempPath, removeError);
+        }
+    }
+
+    bool open(const string& archivePath, string& error) {
+        path = archivePath;
+        tempPath = path + ".tmp";
+        file = fopen(tempPath.c_str(), "wb");
+        if (file == nullptr) {
+            error = "Could not create " + tempPath + ".";
+            return false;
+        }
+        // Page 0 is filled in by finish().
+        string blank(archivePageSize, '\0');
+        nextPage = 0;
+        return writePage(blank, error);
+    }
+
+    bool add(const Course& course, string& error) {
+        // The course just added is always still in the leaf being filled,
+        // so a repeat of it can be taken back out.
+        if (recordCount > 0 && course.courseNumber == lastNumber) {
+            leafUsed -= 2 + 2 + leafRecords.back().size();
+            leafRecords.pop_back();
+            recordCount--;
+        }
+        else if (recordCount > 0 && course.courseNumber < lastNumber) {
+            error = "Course " + course.courseNumber + " is out of order; the courses must be "
+                    "sorted by course number.";
+            return false;
+        }
+        if (course.courseNumber.size() >= archiveKeySize) {
+            error = "Course number " + course.courseNumber + " is too long.";
+            return false;
+        }
+
+        string record;
+        encodeCourse(record, course);
+        if (archiveHeaderSize + 2 + 2 + record.size() > archivePageSize) {
+            error = "Course " + course.courseNumber + " does not fit in a page.";
+            return false;
+        }
+        if (leafUsed + 2 + 2 + record.size() > archivePageSize) {
+            if (!flushLeaf(false, error)) {
+                return false;
+            }
+        }
+
+        if (leafRecords.empty()) {
+            leafFirstKey = course.courseNumber;
+        }
+        leafUsed += 2 + 2 + record.size();
+        leafRecords.push_back(move(record));
+        lastNumber = course.courseNumber;
+        recordCount++;
+        return true;
+    }
+
+    bool finish(string& error) {
+        if (!flushLeaf(true, error)) {
+            return false;
+        }
+
+        // Build the inner levels until one page is left.
+        vector<pair<string, uint32_t>> level = move(leafEntries);
+        uint32_t height = level.empty() ? 0 : 1;
+        while (level.size() > 1) {
+            vector<pair<string, uint32_t>> parents;
+            for (size_t begin = 0; begin < level.size(); begin += archiveFanout) {
+                size_t end = min(level.size(), begin + archiveFanout);
+                string page(archivePageSize, '\0');
+                writePageHeader(page, archiveInner, static_cast<uint16_t>(end - begin), 0);
+                for (size_t i = begin; i < end; ++i) {
+                    uint32_t child = level[i].second;
+                    memcpy(&page[archiveHeaderSize + 4 * (i - begin)], &child, 4);
+                    if (i > begin) {
+                        size_t keyOffset = archiveHeaderSize + 4 * archiveFanout
+                                         + archiveKeySize * (i - begin - 1);
+                        page[keyOffset] = static_cast<char>(level[i].first.size());
+                        memcpy(&page[keyOffset + 1], level[i].first.data(), level[i].first.size());
+                    }
+                }
+                parents.push_back({ level[begin].first, nextPage });
+                if (!writePage(page, error)) {
+                    return false;
+                }
+            }
+            level = move(parents);
+            height++;
+        }
+
+        string header(archivePageSize, '\0');
+        memcpy(&header[0], archiveMagic, 8);
+        uint32_t fields[4] = { archivePageSize, level.empty() ? 0 : level[0].second, height,
+                               firstLeaf };
+        memcpy(&header[8], fields, sizeof(fields));
+        memcpy(&header[8 + sizeof(fields)], &recordCount, sizeof(recordCount));
+        if (fseek(file, 0, SEEK_SET) != 0 || fwrite(header.data(), 1, header.size(), file) != header.size()
+            || !syncFile(file)) {
+            error = "Could not write " + tempPath + ".";
+            return false;
+        }
+        fclose(file);
+        file = nullptr;
+
+        error_code renameError;
+        filesystem::rename(tempPath, path, renameError);
+        if (renameError) {
+            error = "Could not replace " + path + ".";
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t size() const {
+        return recordCount;
+    }
+
+private:
+    FILE* file = nullptr;
+    string path;
+    string tempPath;
+    uint32_t nextPage = 0;
+    uint32_t firstLeaf = 0;
+    uint64_t recordCount = 0;
+    string lastNumber;
+
+    // The leaf being filled, held until the next one starts so its next
+    // pointer is known.
+    vector<string> leafRecords;
+    string leafFirstKey;
+    size_t leafUsed = archiveHeaderSize;
+    vector<pair<string, uint32_t>> leafEntries;   // first key and page of each leaf
+
+    static void writePageHeader(string& page, uint8_t kind, uint16_t count, uint32_t next) {
+        page[0] = static_cast<char>(kind);
+        memcpy(&page[2], &count, 2);
+        memcpy(&page[4], &next, 4);
+    }
+
+    bool writePage(const string& page, string& error) {
+        if (fwrite(page.data(), 1, page.size(), file) != page.size()) {
+            error = "Could not write " + tempPath + ".";
+            return false;
+        }
+        nextPage++;
+        return true;
+    }
+
+    bool flushLeaf(bool last, string& error) {
+        if (leafRecords.empty()) {
+            return true;
+        }
+        uint32_t page = nextPage;
+        string contents(archivePageSize, '\0');
+        writePageHeader(contents, archiveLeaf, static_cast<uint16_t>(leafRecords.size()),
+                        last ? 0 : page + 1);
+        size_t end = archivePageSize;
+        for (size_t i = 0; i < leafRecords.size(); ++i) {
+            uint16_t length = static_cast<uint16_t>(leafRecords[i].size());
+            end -= 2 + length;
+            uint16_t offset = static_cast<uint16_t>(end);
+            memcpy(&contents[archiveHeaderSize + 2 * i], &offset, 2);
+            memcpy(&contents[end], &length, 2);
+            memcpy(&contents[end + 2], leafRecords[i].data(), length);
+        }
+
+        if (firstLeaf == 0) {
+            firstLeaf = page;
+        }
+        leafEntries.push_back({ leafFirstKey, page });
+        leafRecords.clear();
+        leafUsed = archiveHeaderSize;
+        return writePage(contents, error);
+    }
+};
+
+// Reads an archive a page at a time. Pages are kept in a fixed number of
+// cache frames, replaced with the clock algorithm, so memory use stays
+// the same however large the archive is. On Unix pages are read with
+// pread.
+class ArchiveReader {
+public:
+    ~ArchiveReader() {
+        close();
+    }
+
+    bool open(const string& path, size_t cachePages, string& error) {
+        close();
+#if defined(__unix__) || defined(__APPLE__)
+        fd = ::open(path.c_str(), O_RDONLY);
+        bool opened = fd >= 0;
+#else
+        file = fopen(path.c_str(), "rb");
+        bool opened = file != nullptr;
+#endif
+        if (!opened) {
+            error = "Could not open " + path + ".";
+            return false;
+        }
+
+        char header[8 + 4 * sizeof(uint32_t) + sizeof(uint64_t)];
+        uint32_t fields[4];
+        if (!readAt(header, sizeof(header), 0) || memcmp(header, archiveMagic, 8) != 0) {
+            error = path + " is not a course archive.";
+            close();
+            return false;
+        }
+        memcpy(fields, header + 8, sizeof(fields));
+        memcpy(&recordCount, header + 8 + sizeof(fields), sizeof(recordCount));
+        if (fields[0] != archivePageSize) {
+            error = path + " uses a different page size.";
+            close();
+            return false;
+        }
+        rootPage = fields[1];
+        height = fields[2];
+        firstLeaf = fields[3];
+
+        cachePages = max<size_t>(cachePages, 2);
+        frames.assign(cachePages * archivePageSize, '\0');
+        framePage.assign(cachePages, 0);
+        frameReferenced.assign(cachePages, false);
+        pageFrame.clear();
+        pageFrame.reserve(cachePages);
+        hand = 0;
+        reads = 0;
+        hits = 0;
+        return true;
+    }
+
+    void close() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+#else
+        if (file != nullptr) {
+            fclose(file);
+            file = nullptr;
+        }
+#endif
+        frames.clear();
+        pageFrame.clear();
+    }
+
+    uint64_t size() const {
+        return recordCount;
+    }
+
+    // Pages read from the file and pages found in the cache so far.
+    uint64_t pageReads() const {
+        return reads;
+    }
+
+    uint64_t cacheHits() const {
+        return hits;
+    }
+
+    // Find a course by number. Returns false if it is not in the archive
+    // or a page could not be read.
+    bool find(string_view number, Course& course) {
+        CourseKey key = canonicalCourseKey(number);
+        uint32_t pageNumber;
+        size_t slot;
+        if (!key.valid || !seek(key.view(), pageNumber, slot)) {
+            return false;
+        }
+        const char* page = fetch(pageNumber);
+        return page != nullptr && slot < pageCount(page) && recordNumber(page, slot) == key.view()
+            && decodeRecord(page, slot, course);
+    }
+
+    // Call visit with each course numbered from first to last, inclusive,
+    // in course number order, until visit returns false. An empty last
+    // means no upper limit. Returns false if a page could not be read.
+    bool scan(string_view first, string_view last, const function<bool(const Course&)>& visit) {
+        CourseKey firstKey = canonicalCourseKey(first);
+        CourseKey lastKey = canonicalCourseKey(last);
+        uint32_t pageNumber;
+        size_t slot;
+        if (recordCount == 0) {
+            return true;
+        }
+        if (!seek(firstKey.view(), pageNumber, slot)) {
+            return false;
+        }
+
+        Course course;
+        while (pageNumber != 0) {
+            const char* page = fetch(pageNumber);
+            if (page == nullptr) {
+                return false;
+            }
+            size_t count = pageCount(page);
+            uint32_t next;
+            memcpy(&next, page + 4, 4);
+            for (; slot < count; ++slot) {
+                if (!lastKey.empty() && recordNumber(page, slot) > lastKey.view()) {
+                    return true;
+                }
+                if (!decodeRecord(page, slot, course)) {
+                    return false;
+                }
+                if (!visit(course)) {
+                    return true;
+                }
+                // visit may have caused other pages to be read.
+                page = fetch(pageNumber);
+                if (page == nullptr) {
+                    return false;
+                }
+            }
+            pageNumber = next;
+            slot = 0;
+        }
+        return true;
+    }
+
+    // Ask the operating system to drop the file from its own cache, so the
+    // next reads come from the disk. Does nothing where that is not
+    // supported.
+    void dropOsCache() {
+#if defined(__linux__)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    }
+
+private:
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = -1;
+#else
+    FILE* file = nullptr;
+#endif
+    uint32_t rootPage = 0;
+    uint32_t height = 0;
+    uint32_t firstLeaf = 0;
+    uint64_t recordCount = 0;
+
+    string frames;                       // cachePages pages, back to back
+    vector<uint32_t> framePage;          // frame -> page number
+    vector<bool> frameReferenced;        // clock reference bits
+    unordered_map<uint32_t, size_t> pageFrame;
+    size_t hand = 0;
+    uint64_t reads = 0;
+    uint64_t hits = 0;
+
+    bool readAt(char* buffer, size_t length, uint64_t offset) {
+#if defined(__unix__) || defined(__APPLE__)
+        return pread(fd, buffer, length, static_cast<off_t>(offset)) == static_cast<ssize_t>(length);
+#else
+        return fseek(file, static_cast<long>(offset), SEEK_SET) == 0
+            && fread(buffer, 1, length, file) == length;
+#endif
+    }
+
+    // Return a page from the cache, reading it into a free or replaced
+    // frame if needed. The pointer is valid until the next fetch.
+    const char* fetch(uint32_t pageNumber) {
+        auto found = pageFrame.find(pageNumber);
+        if (found != pageFrame.end()) {
+            hits++;
+            frameReferenced[found->second] = true;
+            return &frames[found->second * archivePageSize];
+        }
+
+        // Pass over referenced frames, clearing their bits, until one
+        // that has not been used since the last pass comes up.
+        size_t frameCount = framePage.size();
+        while (frameReferenced[hand]) {
+            frameReferenced[hand] = false;
+            hand = (hand + 1) % frameCount;
+        }
+        size_t frame = hand;
+        hand = (hand + 1) % frameCount;
+        if (framePage[frame] != 0) {
+            pageFrame.erase(framePage[frame]);
+        }
+
+        char* page = &frames[frame * archivePageSize];
+        framePage[frame] = 0;
+        if (!readAt(page, archivePageSize, static_cast<uint64_t>(pageNumber) * archivePageSize)
+            || !isPageValid(page)) {
+            return nullptr;
+        }
+        reads++;
+        framePage[frame] = pageNumber;
+        frameReferenced[frame] = true;
+        pageFrame[pageNumber] = frame;
+        return page;
+    }
+
+    static size_t pageCount(const char* page) {
+        uint16_t count;
+        memcpy(&count, page + 2, 2);
+        return count;
+    }
+
+    // Check that a page read from the file can be used without reading
+    // past its end: every record of a leaf, with its course number, lies
+    // between the offsets and the end of the page, and an inner page has
+    // between one and archiveFanout children with keys that fit. A
+    // damaged page is treated like one that could not be read.
+    static bool isPageValid(const char* page) {
+        size_t count = pageCount(page);
+        if (page[0] == archiveInner) {
+            if (count == 0 || count > archiveFanout) {
+                return false;
+            }
+            const char* keys = page + archiveHeaderSize + 4 * archiveFanout;
+            for (size_t i = 0; i + 1 < count; ++i) {
+                if (static_cast<uint8_t>(keys[archiveKeySize * i]) >= archiveKeySize) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        if (page[0] != archiveLeaf || archiveHeaderSize + 2 * count > archivePageSize) {
+            return false;
+        }
+        for (size_t slot = 0; slot < count; ++slot) {
+            uint16_t offset;
+            uint16_t length;
+            uint32_t numberLength;
+            memcpy(&offset, page + archiveHeaderSize + 2 * slot, 2);
+            if (offset < archiveHeaderSize + 2 * count
+                || static_cast<uint32_t>(offset) + 2 + 4 > archivePageSize) {
+                return false;
+            }
+            memcpy(&length, page + offset, 2);
+            memcpy(&numberLength, page + offset + 2, 4);
+            if (static_cast<uint32_t>(offset) + 2 + length > archivePageSize || length < 4
+                || numberLength > static_cast<uint32_t>(length - 4)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The course number of a record, read straight from its encoding.
+    // Only pages that passed isPageValid are read.
+    static string_view recordNumber(const char* page, size_t slot) {
+        uint16_t offset;
+        uint32_t length;
+        memcpy(&offset, page + archiveHeaderSize + 2 * slot, 2);
+        memcpy(&length, page + offset + 2, 4);
+        return string_view(page + offset + 2 + 4, length);
+    }
+
+    static bool decodeRecord(const char* page, size_t slot, Course& course) {
+        uint16_t offset;
+        uint16_t length;
+        memcpy(&offset, page + archiveHeaderSize + 2 * slot, 2);
+        memcpy(&length, page + offset, 2);
+        ByteReader reader{ page + offset + 2, page + offset + 2 + length };
+        return decodeCourse(reader, course) && decodeCourseColumns(reader, course);
+    }
+
+    // Walk from the root to the leaf that holds number, or would hold it,
+    // and find the first slot in it at or after number. The slot may be
+    // past the end of the leaf.
+    bool seek(string_view number, uint32_t& pageNumber, size_t& slot) {
+        pageNumber = rootPage;
+        for (uint32_t level = 1; level < height; ++level) {
+            const char* page = fetch(pageNumber);
+            if (page == nullptr || page[0] != archiveInner) {
+                return false;
+            }
+            size_t count = pageCount(page);
+            const char* keys = page + archiveHeaderSize + 4 * archiveFanout;
+
+            // The child is the number of separator keys <= number.
+            size_t low = 0;
+            size_t high = count - 1;
+            while (low < high) {
+                size_t middle = (low + high) / 2;
+                const char* key = keys + archiveKeySize * middle;
+                if (string_view(key + 1, static_cast<uint8_t>(key[0])) <= number) {
+                    low = middle + 1;
+                }
+                else {
+                    high = middle;
+                }
+            }
+            memcpy(&pageNumber, page + archiveHeaderSize + 4 * low, 4);
+        }
+
+        const char* page = fetch(pageNumber);
+        if (page == nullptr || page[0] != archiveLeaf) {
+            return false;
+        }
+        size_t low = 0;
+        size_t high = pageCount(page);
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (recordNumber(page, middle) < number) {
+                low = middle + 1;
+            }
+            else {
+                high = middle;
+            }
+        }
+        slot = low;
+
+        // Past the end of this leaf, the next course is the first of the
+        // next leaf.
+        if (slot == pageCount(page)) {
+            uint32_t next;
+            memcpy(&next, page + 4, 4);
+            if (next != 0) {
+                pageNumber = next;
+                slot = 0;
+            }
+        }
+        return true;
+    }
+};
+
+// Build an archive from a course file that is already sorted by course
+// number. The file is read in blocks, and after each block its courses
+// are written and its warnings printed, so memory use does not grow with
+// the file. Archives do not store cross-listed numbers, so ALIAS lines
+// are reported and skipped.
+bool buildArchiveFromFile(const string& courseFile, const string& archivePath, uint64_t& courseCount,
+                          string& error) {
+    ifstream input(courseFile, ios::binary);
+    if (!input.is_open()) {
+        error = "Could not open " + courseFile + ".";
+        return false;
+    }
+
+    ArchiveBuilder builder;
+    if (!builder.open(archivePath, error)) {
+        return false;
+    }
+
+    ParsedCatalogFile parsed;
+    parsed.fileName = courseFile;
+    CatalogParser parser(parsed);
+    auto addParsed = [&]() {
+        parser.flushMessages();
+        cout << parsed.messages;
+        parsed.messages.clear();
+        for (const vector<string>& group : parsed.aliasGroups) {
+            cout << "File format warning in " << courseFile << ": the cross-listing of "
+                 << group[0];
+            for (size_t i = 1; i < group.size(); ++i) {
+                cout << ", " << group[i];
+            }
+            cout << " was ignored; archives do not store cross-listed numbers." << endl;
+        }
+        parsed.aliasGroups.clear();
+        for (const Course& course : parsed.courses) {
+            if (!builder.add(course, error)) {
+                return false;
+            }
+        }
+        parsed.courses.clear();
+        return true;
+    };
+
+    vector<char> block(1 << 20);
+    while (input) {
+        input.read(block.data(), static_cast<streamsize>(block.size()));
+        parser.feed(block.data(), static_cast<size_t>(input.gcount()));
+        if (!addParsed()) {
+            return false;
+        }
+    }
+    parser.finish();
+    if (!addParsed() || !builder.finish(error)) {
+        return false;
+    }
+    courseCount = builder.size();
+    return true;
+}
+
+// -----------------------------
+// Catalog index
+// -----------------------------
+
+// Mix the bits of a 64-bit value (the splitmix64 finalizer).
+inline uint64_t mixBits(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ULL;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
+
+// Map a 64-bit hash onto [0, range) without a division.
+inline uint32_t reduceHash(uint64_t hash, uint32_t range) {
+    return static_cast<uint32_t>(((hash >> 32) * range) >> 32);
+}
+
+// A minimal perfect hash function over a fixed set of keys: every key in
+// the set maps to a different slot in [0, size()), so a lookup is one
+// probe with no collisions to resolve. Keys not in the set map to some
+// slot too, so the caller must check the key stored there.
+//
+// The layout follows PTHash. The keys are split into partitions of about
+// 64K keys that are built independently, in parallel for large sets. In a
+// partition the keys are hashed into buckets averaging six keys, and each
+// bucket gets a 16-bit pilot, found by trying values in turn, that sends
+// all of its keys to free positions of a table 2% larger than the key
+// count. Positions past the key count are then remapped onto the free
+// positions below it. That costs about 3 bits per key for the pilots and
+// under 1 bit per key for the remap table.
+class CourseNumberHash {
+public:
+    // Build the function over keys that are all different. Returns false,
+    // leaving the function empty, if no pilots could be found, which only
+    // happens if two keys have the same 64-bit hash.
+    bool build(const vector<string_view>& keys, size_t threadCount = workerThreadCount()) {
+        clear();
+        keyCount = keys.size();
+        if (keyCount == 0) {
+            return true;
+        }
+
+        vector<uint64_t> hashes(keyCount);
+        parallelFor(keyCount, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                hashes[i] = hashContents(keys[i]);
+            }
+        });
+
+        // Group the hashes by partition with a counting sort.
+        size_t partitionCount = (keyCount + partitionTarget - 1) / partitionTarget;
+        partitions.resize(partitionCount);
+        vector<uint32_t> partitionStart(partitionCount + 1, 0);
+        for (uint64_t hash : hashes) {
+            partitionStart[partitionOf(hash) + 1]++;
+        }
+        for (size_t p = 0; p < partitionCount; ++p) {
+            partitionStart[p + 1] += partitionStart[p];
+        }
+        vector<uint64_t> grouped(keyCount);
+        vector<uint32_t> next(partitionStart.begin(), partitionStart.end() - 1);
+        for (uint64_t hash : hashes) {
+            grouped[next[partitionOf(hash)]++] = hash;
+        }
+
+        vector<vector<uint16_t>> partitionPilots(partitionCount);
+        vector<vector<uint32_t>> partitionRemap(partitionCount);
+        atomic<size_t> nextPartition(0);
+        atomic<bool> failed(false);
+        auto worker = [&]() {
+            for (size_t p = nextPartition++; p < partitionCount && !failed; p = nextPartition++) {
+                partitions[p].offset = partitionStart[p];
+                partitions[p].keyCount = partitionStart[p + 1] - partitionStart[p];
+                if (!buildPartition(&grouped[partitionStart[p]], partitions[p],
+                                    partitionPilots[p], partitionRemap[p])) {
+                    failed = true;
+                }
+            }
+        };
+        vector<thread> workers;
+        for (size_t t = 1; t < min(threadCount, partitionCount); ++t) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (thread& thread : workers) {
+            thread.join();
+        }
+        if (failed) {
+            clear();
+            return false;
+        }
+
+        for (size_t p = 0; p < partitionCount; ++p) {
+            partitions[p].pilotStart = static_cast<uint32_t>(pilots.size());
+            partitions[p].remapStart = static_cast<uint32_t>(remap.size());
+            pilots.insert(pilots.end(), partitionPilots[p].begin(), partitionPilots[p].end());
+            remap.insert(remap.end(), partitionRemap[p].begin(), partitionRemap[p].end());
+        }
+        return true;
+    }
+
+    void clear() {
+        keyCount = 0;
+        partitions.clear();
+        pilots.clear();
+        remap.clear();
+    }
+
+    // Number of keys, which is also the number of slots.
+    size_t size() const {
+        return keyCount;
+    }
+
+    // The slot of a key. Only meaningful when size() is not 0.
+    uint32_t slot(string_view key) const {
+        uint64_t hash = hashContents(key);
+        const Partition& partition = partitions[partitionOf(hash)];
+        uint32_t bucket = bucketOf(hash, partition);
+        uint32_t position = positionOf(hash, pilots[partition.pilotStart + bucket], partition);
+        if (position >= partition.keyCount) {
+            position = remap[partition.remapStart + position - partition.keyCount];
+        }
+        return partition.offset + position;
+    }
+
+    // Memory used by the function, in bits per key.
+    double bitsPerKey() const {
+        if (keyCount == 0) {
+            return 0.0;
+        }
+        size_t bytes = pilots.size() * sizeof(uint16_t) + remap.size() * sizeof(uint32_t)
+                     + partitions.size() * sizeof(Partition);
+        return 8.0 * bytes / keyCount;
+    }
+
+private:
+    static constexpr size_t partitionTarget = 65536;
+    static constexpr size_t keysPerBucket = 6;
+    static constexpr double loadFactor = 0.98;
+    static constexpr int seedAttempts = 8;
+
+    struct Partition {
+        uint32_t offset = 0;       // first slot of the partition
+        uint32_t keyCount = 0;
+        uint32_t tableSize = 0;    // positions before remapping
+        uint32_t bucketCount = 0;
+        uint32_t pilotStart = 0;
+        uint32_t remapStart = 0;
+        uint64_t seed = 0;
+    };
+
+    size_t keyCount = 0;
+    vector<Partition> partitions;
+    vector<uint16_t> pilots;
+    vector<uint32_t> remap;
+
+    uint32_t partitionOf(uint64_t hash) const {
+        return reduceHash(mixBits(hash), static_cast<uint32_t>(partitions.size()));
+    }
+
+    // Buckets are sized unevenly, with 60% of the keys going to the first
+    // 30% of the buckets. Placing those large buckets first, while the
+    // table is mostly empty, leaves only small buckets for the end, when
+    // few free positions are left.
+    static uint32_t bucketOf(uint64_t hash, const Partition& partition) {
+        uint64_t mixed = mixBits(hash ^ partition.seed);
+        uint32_t denseBuckets = (partition.bucketCount * 3 + 9) / 10;
+        bool dense = mixed < 0x9999999999999999ULL;   // 60% of the range
+        if (dense || denseBuckets == partition.bucketCount) {
+            return reduceHash(mixBits(mixed), denseBuckets);
+        }
+        return denseBuckets + reduceHash(mixBits(mixed), partition.bucketCount - denseBuckets);
+    }
+
+    static uint32_t positionOf(uint64_t hash, uint16_t pilot, const Partition& partition) {
+        return static_cast<uint32_t>(mixBits(hash ^ partition.seed ^ mixBits(pilot + 1))
+                                     % partition.tableSize);
+    }
+
+    // Find a pilot for every bucket of one partition, trying a few seeds.
+    static bool buildPartition(const uint64_t* hashes, Partition& partition,
+                               vector<uint16_t>& pilotsOut, vector<uint32_t>& remapOut) {
+        uint32_t count = partition.keyCount;
+        partition.tableSize = max<uint32_t>(count, static_cast<uint32_t>(ceil(count / loadFactor)));
+        partition.bucketCount = static_cast<uint32_t>((count + keysPerBucket - 1) / keysPerBucket);
+
+        for (int attempt = 0; attempt < seedAttempts; ++attempt) {
+            partition.seed = mixBits(static_cast<uint64_t>(partition.offset) * 131 + attempt);
+
+            // Group the keys by bucket with a counting sort.
+            vector<uint32_t> bucketStart(partition.bucketCount + 1, 0);
+            vector<uint32_t> bucketOf(count);
+            for (uint32_t i = 0; i < count; ++i) {
+                bucketOf[i] = CourseNumberHash::bucketOf(hashes[i], partition);
+                bucketStart[bucketOf[i] + 1]++;
+            }
+            for (uint32_t b = 0; b < partition.bucketCount; ++b) {
+                bucketStart[b + 1] += bucketStart[b];
+            }
+            vector<uint64_t> bucketHashes(count);
+            vector<uint32_t> next(bucketStart.begin(), bucketStart.end() - 1);
+            for (uint32_t i = 0; i < count; ++i) {
+                bucketHashes[next[bucketOf[i]]++] = hashes[i];
+            }
+
+            // Place the largest buckets first, while the table is empty.
+            vector<uint32_t> order(partition.bucketCount);
+            for (uint32_t b = 0; b < partition.bucketCount; ++b) {
+                order[b] = b;
+            }
+            stable_sort(order.begin(), order.end(), [&bucketStart](uint32_t a, uint32_t b) {
+                return bucketStart[a + 1] - bucketStart[a] > bucketStart[b + 1] - bucketStart[b];
+            });
+
+            pilotsOut.assign(partition.bucketCount, 0);
+            vector<bool> taken(partition.tableSize, false);
+            vector<uint32_t> positions;
+            bool placedAll = true;
+            for (uint32_t bucket : order) {
+                bool placed = false;
+                for (uint32_t pilot = 0; pilot <= UINT16_MAX && !placed; ++pilot) {
+                    positions.clear();
+                    placed = true;
+                    for (uint32_t k = bucketStart[bucket]; k < bucketStart[bucket + 1]; ++k) {
+                        uint32_t position = positionOf(bucketHashes[k], static_cast<uint16_t>(pilot),
+                                                       partition);
+                        if (taken[position]
+                            || find(positions.begin(), positions.end(), position) != positions.end()) {
+                            placed = false;
+                            break;
+                        }
+                        positions.push_back(position);
+                    }
+                    if (placed) {
+                        pilotsOut[bucket] = static_cast<uint16_t>(pilot);
+                        for (uint32_t position : positions) {
+                            taken[position] = true;
+                        }
+                    }
+                }
+                if (!placed) {
+                    placedAll = false;
+                    break;
+                }
+            }
+            if (!placedAll) {
+                continue;
+            }
+
+            // Send each used position past the key count to a free one below it.
+            remapOut.assign(partition.tableSize - count, 0);
+            uint32_t freePosition = 0;
+            for (uint32_t position = count; position < partition.tableSize; ++position) {
+                if (taken[position]) {
+                    while (taken[freePosition]) {
+                        freePosition++;
+                    }
+                    remapOut[position - count] = freePosition++;
+                }
+            }
+            return true;
+        }
+        return false;
+    }
+};
+
+// A flat, column-per-field view of the loaded catalog. Each course gets an
+// ID equal to its position in course number order, and every column is
+// indexed by that ID. Queries and reports scan these arrays instead of
+// walking the tree and re-parsing course numbers for every course.
+struct CatalogIndex {
+    uint64_t sourceHash = 0;
+    vector<Course*> courses;          // course ID -> course
+    vector<string> departmentNames;   // department ID -> name, e.g. "CSCI"
+    vector<uint16_t> department;      // course ID -> department ID
+    vector<uint32_t> number;          // course ID -> numeric part, e.g. 300
+    vector<uint16_t> prereqCount;     // course ID -> number of prerequisites
+
+    // The optional columns from files with a header line, one byte per
+    // course for credits and terms. Campuses are numbered like departments.
+    vector<uint8_t> creditHours;      // course ID -> credit hours, 0 if not given
+    vector<uint8_t> termsOffered;     // course ID -> termFall | termSpring | ...
+    vector<string> campusNames;       // campus ID -> name, "" if not given
+    vector<uint16_t> campus;          // course ID -> campus ID
+
+    // Course IDs in alternate listing orders, so listings other than by
+    // course number are a linear walk instead of a sort per request.
+    vector<uint32_t> byTitle;
+    vector<uint32_t> byDepartmentTitle;
+
+    // Cross-listed course numbers and the IDs of their courses, sorted by
+    // number. Course numbers themselves are found by binary search on
+    // courses, which is already in course number order.
+    vector<pair<string, uint32_t>> aliasIds;
+
+    // A minimal perfect hash over every course and cross-listed number.
+    // numberHashEntry[slot] is the course ID for a course number, or
+    // size() plus the aliasIds position for a cross-listed number, and is
+    // used to check that the number looked up is the one in that slot.
+    CourseNumberHash numberHash;
+    vector<uint32_t> numberHashEntry;
+
+    // The prerequisite graph in compressed sparse row form. The
+    // prerequisites of course c are prereqIds[prereqStart[c]] up to
+    // prereqIds[prereqStart[c + 1] - 1], and the courses that list c as a
+    // prerequisite are stored the same way in dependentStart/dependentIds.
+    // Prerequisites that are not in the catalog are left out.
+    vector<uint32_t> prereqStart;
+    vector<uint32_t> prereqIds;
+    vector<uint32_t> dependentStart;
+    vector<uint32_t> dependentIds;
+
+    // Longest prerequisite chain ending at each course, counted in courses
+    // (so it is also the minimum number of terms needed to take the
+    // course), and the prerequisite before it on that chain. Courses that
+    // are part of a prerequisite cycle have a chain length of 0.
+    vector<uint32_t> chainLength;
+    vector<uint32_t> chainPrevious;
+    uint32_t longestChainEnd = noCourse;
+
+    // Each course's prerequisites as a sparse bit mask over course IDs:
+    // for entries prereqMaskStart[c] up to prereqMaskStart[c + 1] - 1, the
+    // bits prereqMaskBits[e] must all be set in word prereqMaskWord[e] of a
+    // completed-course bitmap. Courses with fewer than two entries are
+    // padded with empty masks. prereqFlags[c] marks courses that list a
+    // prerequisite not in the catalog (they can never be taken) and
+    // courses checked by a rule program instead of a mask.
+    vector<uint32_t> prereqMaskStart;
+    vector<uint32_t> prereqMaskWord;
+    vector<uint64_t> prereqMaskBits;
+    vector<uint8_t> prereqFlags;
+
+    static constexpr uint8_t prereqMissing = 1;
+    static constexpr uint8_t prereqHasRule = 2;
+
+    // Courses with a prerequisite rule instead have a small postfix
+    // program, stored as ruleCode[ruleStart[c]] up to
+    // ruleCode[ruleStart[c + 1] - 1]. Each instruction holds an opcode in
+    // the top two bits and a course ID in the rest. Courses without a rule
+    // have an empty program.
+    vector<uint32_t> ruleStart;
+    vector<uint32_t> ruleCode;
+
+    static constexpr uint32_t rulePush = 0u << 30;    // push "course completed"
+    static constexpr uint32_t ruleFalse = 1u << 30;   // push false (course not in catalog)
+    static constexpr uint32_t ruleAnd = 2u << 30;
+    static constexpr uint32_t ruleOr = 3u << 30;
+    static constexpr uint32_t ruleOpMask = 3u << 30;
+
+    static constexpr uint32_t noCourse = UINT32_MAX;
+
+    size_t size() const {
+        return courses.size();
+    }
+};
+
+// Split a course number such as "CSCI300" into its department letters and
+// the number that follows them. Returns 0 for the number if there is none.
+void splitCourseNumber(const string& courseNumber, string& department, uint32_t& number) {
+    size_t i = 0;
+    while (i < courseNumber.size() && isalpha(static_cast<unsigned char>(courseNumber[i]))) {
+        i++;
+    }
+    department = toUpper(courseNumber.substr(0, i));
+
+    number = 0;
+    while (i < courseNumber.size() && isdigit(static_cast<unsigned char>(courseNumber[i]))
+           && number < 100000000) {
+        number = number * 10 + static_cast<uint32_t>(courseNumber[i] - '0');
+        i++;
+    }
+}
+
+// Build the title and department-then-title listing orders. The collation
+// key (the upper-case title) is computed once per course instead of once
+// per comparison, and equal keys fall back to course number order.
+void buildListingOrders(CatalogIndex& index) {
+    size_t count = index.size();
+    vector<string> titleKeys(count);
+    for (size_t id = 0; id < count; ++id) {
+        titleKeys[id] = toUpper(index.courses[id]->courseTitle);
+    }
+
+    // Department IDs are handed out in course number order, which is not
+    // always alphabetical, so rank the department names first.
+    vector<uint32_t> departmentRank(index.departmentNames.size());
+    vector<uint32_t> departments(index.departmentNames.size());
+    for (uint32_t d = 0; d < departments.size(); ++d) {
+        departments[d] = d;
+    }
+    sort(departments.begin(), departments.end(), [&index](uint32_t a, uint32_t b) {
+        return index.departmentNames[a] < index.departmentNames[b];
+    });
+    for (uint32_t rank = 0; rank < departments.size(); ++rank) {
+        departmentRank[departments[rank]] = rank;
+    }
+
+    auto sortByTitle = [&]() {
+        index.byTitle.resize(count);
+        for (size_t id = 0; id < count; ++id) {
+            index.byTitle[id] = static_cast<uint32_t>(id);
+        }
+        sort(index.byTitle.begin(), index.byTitle.end(), [&titleKeys](uint32_t a, uint32_t b) {
+            int order = titleKeys[a].compare(titleKeys[b]);
+            return order != 0 ? order < 0 : a < b;
+        });
+    };
+    auto sortByDepartmentTitle = [&]() {
+        index.byDepartmentTitle.resize(count);
+        for (size_t id = 0; id < count; ++id) {
+            index.byDepartmentTitle[id] = static_cast<uint32_t>(id);
+        }
+        sort(index.byDepartmentTitle.begin(), index.byDepartmentTitle.end(),
+             [&](uint32_t a, uint32_t b) {
+                 uint32_t rankA = departmentRank[index.department[a]];
+                 uint32_t rankB = departmentRank[index.department[b]];
+                 if (rankA != rankB) {
+                     return rankA < rankB;
+                 }
+                 int order = titleKeys[a].compare(titleKeys[b]);
+                 return order != 0 ? order < 0 : a < b;
+             });
+    };
+
+    // The two sorts are independent, so large catalogs sort them at the
+    // same time.
+    if (count >= 10000) {
+        thread titleSorter(sortByTitle);
+        sortByDepartmentTitle();
+        titleSorter.join();
+    }
+    else {
+        sortByTitle();
+        sortByDepartmentTitle();
+    }
+}
+
+// Look up the ID of a course by its canonical key with binary searches
+// of the course and cross-listed numbers. Neither the search nor the key
+// allocates. Returns false if the course is not in the catalog.
+bool searchCourseId(const CatalogIndex& index, const CourseKey& key, uint32_t& id) {
+    string_view number = key.view();
+    auto course = lower_bound(index.courses.begin(), index.courses.end(), number,
+                              [](const Course* c, string_view value) {
+                                  return c->courseNumber < value;
+                              });
+    if (course != index.courses.end() && (*course)->courseNumber == number) {
+        id = static_cast<uint32_t>(course - index.courses.begin());
+        return true;
+    }
+
+    auto alias = lower_bound(index.aliasIds.begin(), index.aliasIds.end(), number,
+                             [](const pair<string, uint32_t>& a, string_view value) {
+                                 return a.first < value;
+                             });
+    if (alias != index.aliasIds.end() && alias->first == number) {
+        id = alias->second;
+        return true;
+    }
+    return false;
+}
+
+// Look up the ID of a course by its canonical key: one probe of the
+// perfect hash, then a check of the number in that slot. Falls back to
+// searchCourseId if the hash could not be built.
+bool findCourseId(const CatalogIndex& index, const CourseKey& key, uint32_t& id) {
+    if (index.numberHashEntry.empty()) {
+        return searchCourseId(index, key, id);
+    }
+
+    string_view number = key.view();
+    uint32_t entry = index.numberHashEntry[index.numberHash.slot(number)];
+    if (entry < index.size()) {
+        id = entry;
+        return index.courses[entry]->courseNumber == number;
+    }
+    const pair<string, uint32_t>& alias = index.aliasIds[entry - index.size()];
+    id = alias.second;
+    return alias.first == number;
+}
+
+// Build the perfect hash over the course and cross-listed numbers. If it
+// cannot be built, lookups use binary search instead.
+void buildNumberHash(CatalogIndex& index) {
+    size_t count = index.size();
+    vector<string_view> keys;
+    keys.reserve(count + index.aliasIds.size());
+    for (const Course* course : index.courses) {
+        keys.push_back(course->courseNumber);
+    }
+    for (const pair<string, uint32_t>& alias : index.aliasIds) {
+        keys.push_back(alias.first);
+    }
+
+    index.numberHashEntry.clear();
+    if (!index.numberHash.build(keys)) {
+        return;
+    }
+    index.numberHashEntry.resize(keys.size());
+    parallelFor(keys.size(), [&](size_t begin, size_t end) {
+        for (size_t entry = begin; entry < end; ++entry) {
+            index.numberHashEntry[index.numberHash.slot(keys[entry])] = static_cast<uint32_t>(entry);
+        }
+    });
+}
+
+// Look up the ID of a course by a course number in any spelling.
+bool findCourseId(const CatalogIndex& index, string_view courseNumber, uint32_t& id) {
+    return findCourseId(index, canonicalCourseKey(courseNumber), id);
+}
+
+// Build the prerequisite graph and its reverse from the course records.
+void buildPrerequisiteGraph(CatalogIndex& index) {
+    size_t count = index.size();
+    index.prereqStart.assign(count + 1, 0);
+    index.prereqIds.clear();
+
+    vector<uint32_t> dependentCount(count, 0);
+    for (size_t id = 0; id < count; ++id) {
+        index.prereqStart[id] = static_cast<uint32_t>(index.prereqIds.size());
+        for (const string& prereq : index.courses[id]->prerequisites) {
+            uint32_t prereqId;
+            if (!findCourseId(index, prereq, prereqId)) {
+                continue;
+            }
+            // Skip a prerequisite listed twice for the same course.
+            auto first = index.prereqIds.begin() + index.prereqStart[id];
+            if (find(first, index.prereqIds.end(), prereqId) != index.prereqIds.end()) {
+                continue;
+            }
+            index.prereqIds.push_back(prereqId);
+            dependentCount[prereqId]++;
+        }
+    }
+    index.prereqStart[count] = static_cast<uint32_t>(index.prereqIds.size());
+
+    // Fill in the reverse edges with a counting sort on the prerequisite.
+    index.dependentStart.assign(count + 1, 0);
+    for (size_t id = 0; id < count; ++id) {
+        index.dependentStart[id + 1] = index.dependentStart[id] + dependentCount[id];
+    }
+    index.dependentIds.resize(index.prereqIds.size());
+    vector<uint32_t> next(index.dependentStart.begin(), index.dependentStart.end() - 1);
+    for (size_t id = 0; id < count; ++id) {
+        for (uint32_t e = index.prereqStart[id]; e < index.prereqStart[id + 1]; ++e) {
+            index.dependentIds[next[index.prereqIds[e]]++] = static_cast<uint32_t>(id);
+        }
+    }
+}
+
+// Compile each course's prerequisite list into a sparse bit mask. The
+// prerequisite IDs are sorted so IDs that share a 64-bit word end up in a
+// single mask entry.
+void buildPrerequisiteMasks(CatalogIndex& index) {
+    size_t count = index.size();
+    index.prereqMaskStart.assign(count + 1, 0);
+    index.prereqMaskWord.clear();
+    index.prereqMaskBits.clear();
+    index.prereqFlags.assign(count, 0);
+
+    vector<uint32_t> prereqs;
+    for (size_t id = 0; id < count; ++id) {
+        index.prereqMaskStart[id] = static_cast<uint32_t>(index.prereqMaskWord.size());
+
+        // A course with a rule is checked by its rule program, so its mask
+        // stays empty.
+        if (!index.courses[id]->prerequisiteRule.empty()) {
+            index.prereqFlags[id] = CatalogIndex::prereqHasRule;
+            index.prereqMaskWord.insert(index.prereqMaskWord.end(), 2, 0);
+            index.prereqMaskBits.insert(index.prereqMaskBits.end(), 2, 0);
+            continue;
+        }
+
+        prereqs.assign(index.prereqIds.begin() + index.prereqStart[id],
+                       index.prereqIds.begin() + index.prereqStart[id + 1]);
+        sort(prereqs.begin(), prereqs.end());
+
+        for (uint32_t prereq : prereqs) {
+            uint32_t word = prereq / 64;
+            uint64_t bit = uint64_t(1) << (prereq % 64);
+            if (index.prereqMaskWord.size() > index.prereqMaskStart[id]
+                && index.prereqMaskWord.back() == word) {
+                index.prereqMaskBits.back() |= bit;
+            }
+            else {
+                index.prereqMaskWord.push_back(word);
+                index.prereqMaskBits.push_back(bit);
+            }
+        }
+        while (index.prereqMaskWord.size() - index.prereqMaskStart[id] < 2) {
+            index.prereqMaskWord.push_back(0);
+            index.prereqMaskBits.push_back(0);
+        }
+
+        // The graph leaves out prerequisites that are not in the catalog.
+        for (const string& prereq : index.courses[id]->prerequisites) {
+            uint32_t prereqId;
+            if (!findCourseId(index, prereq, prereqId)) {
+                index.prereqFlags[id] = CatalogIndex::prereqMissing;
+                break;
+            }
+        }
+    }
+    index.prereqMaskStart[count] = static_cast<uint32_t>(index.prereqMaskWord.size());
+}
+
+// Compile each course's prerequisite rule into a postfix program over
+// course IDs.
+void buildPrerequisiteRules(CatalogIndex& index) {
+    size_t count = index.size();
+    index.ruleStart.assign(count + 1, 0);
+    index.ruleCode.clear();
+
+    vector<string> postfix;
+    string error;
+    for (size_t id = 0; id < count; ++id) {
+        index.ruleStart[id] = static_cast<uint32_t>(index.ruleCode.size());
+        const string& rule = index.courses[id]->prerequisiteRule;
+        postfix.clear();
+        if (rule.empty() || !parsePrerequisiteRule(rule, postfix, error)) {
+            continue;
+        }
+
+        for (const string& token : postfix) {
+            uint32_t prereqId;
+            if (token == "AND") {
+                index.ruleCode.push_back(CatalogIndex::ruleAnd);
+            }
+            else if (token == "OR") {
+                index.ruleCode.push_back(CatalogIndex::ruleOr);
+            }
+            else if (findCourseId(index, token, prereqId)) {
+                index.ruleCode.push_back(CatalogIndex::rulePush | prereqId);
+            }
+            else {
+                index.ruleCode.push_back(CatalogIndex::ruleFalse);
+            }
+        }
+    }
+    index.ruleStart[count] = static_cast<uint32_t>(index.ruleCode.size());
+}
+
+// Work out how many terms of prerequisites a course's rule needs, given
+// termsOf(prereq), the minimum number of terms to complete a prerequisite
+// or 0 if it can never be taken. All of the terms joined by AND are
+// needed, so they take the largest count; OR takes the smallest count
+// among its alternatives that can be taken. Returns 0 for a rule that
+// needs nothing and CatalogIndex::noCourse if the rule cannot be
+// satisfied. via is set to the prerequisite that decides the count.
+template <typename TermsOf>
+uint32_t rulePrerequisiteTerms(const CatalogIndex& index, uint32_t id, TermsOf termsOf,
+                               uint32_t& via) {
+    via = CatalogIndex::noCourse;
+    uint32_t first = index.ruleStart[id];
+    uint32_t last = index.ruleStart[id + 1];
+    if (first == last) {
+        return 0;
+    }
+
+    // An unsatisfiable term is noCourse, which max and min then handle
+    // like any other count.
+    pair<uint32_t, uint32_t> stack[maxRuleStackDepth];   // terms, deciding course
+    size_t depth = 0;
+    for (uint32_t pc = first; pc < last; ++pc) {
+        uint32_t instruction = index.ruleCode[pc];
+        uint32_t operation = instruction & CatalogIndex::ruleOpMask;
+        if (operation == CatalogIndex::rulePush) {
+            uint32_t prereq = instruction & ~CatalogIndex::ruleOpMask;
+            uint32_t terms = termsOf(prereq);
+            stack[depth++] = { terms == 0 ? CatalogIndex::noCourse : terms, prereq };
+        }
+        else if (operation == CatalogIndex::ruleFalse) {
+            stack[depth++] = { CatalogIndex::noCourse, CatalogIndex::noCourse };
+        }
+        else {
+            depth--;
+            bool takeRight = operation == CatalogIndex::ruleAnd
+                                 ? stack[depth].first > stack[depth - 1].first
+                                 : stack[depth].first < stack[depth - 1].first;
+            if (takeRight) {
+                stack[depth - 1] = stack[depth];
+            }
+        }
+    }
+    if (stack[0].first != CatalogIndex::noCourse) {
+        via = stack[0].second;
+    }
+    return stack[0].first;
+}
+
+// Compute the longest prerequisite chain ending at every course with one
+// pass over the courses in topological order (Kahn's algorithm). Courses
+// are finished in order of chain length, so when a course's last
+// prerequisite is done, its chain is one longer than that prerequisite's.
+// A course with a rule is finished as soon as its rule can be satisfied
+// by the courses already done, which picks its shortest alternative. A
+// rule that is never satisfied, for example because every alternative is
+// in a cycle, leaves the course untakeable. Courses never finished keep a
+// chain length of 0.
+void buildPrerequisiteChains(CatalogIndex& index) {
+    size_t count = index.size();
+    index.chainLength.assign(count, 0);
+    index.chainPrevious.assign(count, CatalogIndex::noCourse);
+    index.longestChainEnd = CatalogIndex::noCourse;
+
+    // The chain a rule course's prerequisites need among the courses
+    // finished so far, or noCourse if its rule cannot be satisfied yet.
+    auto ruleTerms = [&index](uint32_t id, uint32_t& via) {
+        return rulePrerequisiteTerms(index, id, [&index](uint32_t prereq) {
+            return index.chainLength[prereq];
+        }, via);
+    };
+
+    vector<uint32_t> remaining(count);
+    vector<uint32_t> ready;
+    uint32_t via;
+    for (size_t id = 0; id < count; ++id) {
+        remaining[id] = index.prereqStart[id + 1] - index.prereqStart[id];
+        bool hasRule = (index.prereqFlags[id] & CatalogIndex::prereqHasRule) != 0;
+        if (hasRule ? ruleTerms(static_cast<uint32_t>(id), via) == 0 : remaining[id] == 0) {
+            index.chainLength[id] = 1;
+            ready.push_back(static_cast<uint32_t>(id));
+        }
+    }
+
+    // ready is used as a queue, which keeps it in order of chain length.
+    for (size_t next = 0; next < ready.size(); ++next) {
+        uint32_t id = ready[next];
+
+        if (index.longestChainEnd == CatalogIndex::noCourse
+            || index.chainLength[id] > index.chainLength[index.longestChainEnd]) {
+            index.longestChainEnd = id;
+        }
+
+        for (uint32_t e = index.dependentStart[id]; e < index.dependentStart[id + 1]; ++e) {
+            uint32_t dependent = index.dependentIds[e];
+            uint32_t terms = CatalogIndex::noCourse;
+            via = id;
+            if (index.prereqFlags[dependent] & CatalogIndex::prereqHasRule) {
+                if (index.chainLength[dependent] == 0) {
+                    terms = ruleTerms(dependent, via);
+                }
+            }
+            else if (--remaining[dependent] == 0) {
+                terms = index.chainLength[id];
+            }
+
+            if (terms != CatalogIndex::noCourse) {
+                index.chainLength[dependent] = terms + 1;
+                index.chainPrevious[dependent] = via;
+                ready.push_back(dependent);
+            }
+        }
+    }
+}
+
+// Rebuild the index from the tree.
+void buildCatalogIndex(CourseBST& tree, CatalogIndex& index) {
+    index = CatalogIndex();
+    index.sourceHash = tree.getSourceHash();
+    tree.collectInOrder(index.courses);
+
+    size_t count = index.courses.size();
+    index.department.resize(count);
+    index.number.resize(count);
+    index.prereqCount.resize(count);
+    index.creditHours.resize(count);
+    index.termsOffered.resize(count);
+    index.campus.resize(count);
+
+    unordered_map<string, uint16_t> departmentIds;
+    unordered_map<string, uint16_t> campusIds;
+    string department;
+    for (size_t id = 0; id < count; ++id) {
+        const Course& course = *index.courses[id];
+        splitCourseNumber(course.courseNumber, department, index.number[id]);
+
+        auto found = departmentIds.find(department);
+        if (found == departmentIds.end()) {
+            uint16_t departmentId = static_cast<uint16_t>(index.departmentNames.size());
+            found = departmentIds.emplace(department, departmentId).first;
+            index.departmentNames.push_back(department);
+        }
+        index.department[id] = found->second;
+
+        index.creditHours[id] = course.creditHours;
+        index.termsOffered[id] = course.termsOffered;
+        string campus = toUpper(course.campus);
+        auto foundCampus = campusIds.find(campus);
+        if (foundCampus == campusIds.end()) {
+            uint16_t campusId = static_cast<uint16_t>(index.campusNames.size());
+            foundCampus = campusIds.emplace(campus, campusId).first;
+            index.campusNames.push_back(campus);
+        }
+        index.campus[id] = foundCampus->second;
+        index.prereqCount[id] = static_cast<uint16_t>(
+            min<size_t>(course.prerequisites.size(), UINT16_MAX));
+        for (const string& alias : course.aliases) {
+            index.aliasIds.push_back({ alias, static_cast<uint32_t>(id) });
+        }
+    }
+    sort(index.aliasIds.begin(), index.aliasIds.end());
+    buildNumberHash(index);
+    buildListingOrders(index);
+    buildPrerequisiteGraph(index);
+    buildPrerequisiteMasks(index);
+    buildPrerequisiteRules(index);
+    buildPrerequisiteChains(index);
+}
+
+// Rebuild the index only if the tree has changed since it was built.
+void refreshCatalogIndex(CourseBST& tree, CatalogIndex& index) {
+    if (index.sourceHash != 0 && index.sourceHash == tree.getSourceHash()) {
+        return;
+    }
+    buildCatalogIndex(tree, index);
+}
+
+// -----------------------------
+// Catalog queries
+// -----------------------------
+
+// A query filters the catalog with an expression such as
+//
+//   department in (CS, MATH) and level >= 300 and has no prerequisites
+//
+// Fields: department, number, level (number rounded down to hundreds),
+// prerequisites (count), title, credits, terms, campus. Comparisons:
+// = != < <= > >=, "in (...)", and "contains" for titles and terms. A term
+// list such as "terms contains fall" or "terms in (fall, summer)" matches
+// courses offered in any of the terms; "terms = fall/spring" matches the
+// exact set. Terms combine with and, or, not and
+// parentheses. Keywords and department names are not case sensitive.
+//
+// The text is parsed once into a syntax tree, which is then compiled into
+// a chain of small predicates that read the catalog index columns
+// directly. Constant work such as looking up department names is done at
+// compile time, so evaluation is a tight loop over course IDs.
+
+// One node of a parsed query.
+struct QueryNode {
+    enum Kind { And, Or, Not, Compare, InList, HasPrerequisites };
+
+    Kind kind = Compare;
+    string field;
+    string op;
+    vector<string> values;
+    unique_ptr<QueryNode> left;
+    unique_ptr<QueryNode> right;
+};
+
+// A compiled query: returns true if the course with the given ID matches.
+using QueryPredicate = function<bool(size_t)>;
+
+// Recursive-descent parser for the query language.
+class QueryParser {
+public:
+    // Parse the query text. Returns nullptr and sets error on failure.
+    unique_ptr<QueryNode> parse(const string& text, string& error) {
+        tokens = tokenize(text);
+        position = 0;
+        errorMessage.clear();
+
+        unique_ptr<QueryNode> node = parseOr();
+        if (node && position < tokens.size()) {
+            fail("unexpected '" + tokens[position] + "'");
+        }
+        if (!errorMessage.empty()) {
+            error = errorMessage;
+            return nullptr;
+        }
+        return node;
+    }
+
+private:
+    vector<string> tokens;
+    size_t position = 0;
+    string errorMessage;
+
+    // Split the text into words, numbers, quoted strings, punctuation
+    // and comparison operators.
+    static vector<string> tokenize(const string& text) {
+        vector<string> result;
+        size_t i = 0;
+        while (i < text.size()) {
+            char c = text[i];
+            if (isspace(static_cast<unsigned char>(c))) {
+                i++;
+            }
+            else if (c == '(' || c == ')' || c == ',') {
+                result.push_back(string(1, c));
+                i++;
+            }
+            else if (c == '<' || c == '>' || c == '=' || c == '!') {
+                size_t length = (i + 1 < text.size() && text[i + 1] == '=') ? 2 : 1;
+                result.push_back(text.substr(i, length));
+                i += length;
+            }
+            else if (c == '"' || c == '\'') {
+                size_t close = text.find(c, i + 1);
+                if (close == string::npos) {
+                    close = text.size();
+                }
+                // Keep the opening quote so quoted words are never keywords.
+                result.push_back(text.substr(i, close - i));
+                i = close + 1;
+            }
+            else {
+                size_t start = i;
+                while (i < text.size() && !isspace(static_cast<unsigned char>(text[i]))
+                       && string("()<>=!,\"'").find(text[i]) == string::npos) {
+                    i++;
+                }
+                result.push_back(text.substr(start, i - start));
+            }
+        }
+        return result;
+    }
+
+    void fail(const string& message) {
+        if (errorMessage.empty()) {
+            errorMessage = message;
+        }
+    }
+
+    bool atKeyword(const string& keyword) const {
+        return position < tokens.size() && toUpper(tokens[position]) == toUpper(keyword);
+    }
+
+    bool acceptKeyword(const string& keyword) {
+        if (atKeyword(keyword)) {
+            position++;
+            return true;
+        }
+        return false;
+    }
+
+    bool expectKeyword(const string& keyword) {
+        if (acceptKeyword(keyword)) {
+            return true;
+        }
+        fail("expected '" + keyword + "'");
+        return false;
+    }
+
+    // Read a value token, removing the quote marker from quoted strings.
+    bool readValue(string& value) {
+        if (position >= tokens.size()) {
+            fail("expected a value");
+            return false;
+        }
+        value = tokens[position++];
+        if (value == "(" || value == ")" || value == ",") {
+            fail("expected a value before '" + value + "'");
+            return false;
+        }
+        if (!value.empty() && (value[0] == '"' || value[0] == '\'')) {
+            value = value.substr(1);
+        }
+        return true;
+    }
+
+    static unique_ptr<QueryNode> makeBinary(QueryNode::Kind kind,
+                                            unique_ptr<QueryNode> left,
+                                            unique_ptr<QueryNode> right) {
+        unique_ptr<QueryNode> node(new QueryNode());
+        node->kind = kind;
+        node->left = move(left);
+        node->right = move(right);
+        return node;
+    }
+
+    unique_ptr<QueryNode> parseOr() {
+        unique_ptr<QueryNode> node = parseAnd();
+        while (node && acceptKeyword("or")) {
+            unique_ptr<QueryNode> right = parseAnd();
+            if (!right) {
+                return nullptr;
+            }
+            node = makeBinary(QueryNode::Or, move(node), move(right));
+        }
+        return node;
+    }
+
+    unique_ptr<QueryNode> parseAnd() {
+        unique_ptr<QueryNode> node = parseNot();
+        while (node && acceptKeyword("and")) {
+            unique_ptr<QueryNode> right = parseNot();
+            if (!right) {
+                return nullptr;
+            }
+            node = makeBinary(QueryNode::And, move(node), move(right));
+        }
+        return node;
+    }
+
+    unique_ptr<QueryNode> parseNot() {
+        if (acceptKeyword("not")) {
+            unique_ptr<QueryNode> operand = parseNot();
+            if (!operand) {
+                return nullptr;
+            }
+            return makeBinary(QueryNode::Not, move(operand), nullptr);
+        }
+        return parsePrimary();
+    }
+
+    unique_ptr<QueryNode> parsePrimary() {
+        if (position >= tokens.size()) {
+            fail("query ended too early");
+            return nullptr;
+        }
+
+        if (acceptKeyword("(")) {
+            unique_ptr<QueryNode> node = parseOr();
+            if (!node || !expectKeyword(")")) {
+                return nullptr;
+            }
+            return node;
+        }
+
+        // "has prerequisites" and "has no prerequisites"
+        if (acceptKeyword("has")) {
+            bool negate = acceptKeyword("no");
+            if (!acceptKeyword("prerequisites") && !expectKeyword("prerequisite")) {
+                return nullptr;
+            }
+            unique_ptr<QueryNode> node(new QueryNode());
+            node->kind = QueryNode::HasPrerequisites;
+            if (negate) {
+                return makeBinary(QueryNode::Not, move(node), nullptr);
+            }
+            return node;
+        }
+
+        unique_ptr<QueryNode> node(new QueryNode());
+        node->field = toUpper(tokens[position++]);
+        if (node->field != "DEPARTMENT" && node->field != "NUMBER" && node->field != "LEVEL"
+            && node->field != "PREREQUISITES" && node->field != "TITLE"
+            && node->field != "CREDITS" && node->field != "TERMS" && node->field != "CAMPUS") {
+            fail("unknown field '" + tokens[position - 1] + "'");
+            return nullptr;
+        }
+
+        if (acceptKeyword("in")) {
+            node->kind = QueryNode::InList;
+            if (!expectKeyword("(")) {
+                return nullptr;
+            }
+            do {
+                string value;
+                if (!readValue(value)) {
+                    return nullptr;
+                }
+                node->values.push_back(value);
+            } while (acceptKeyword(","));
+            if (!expectKeyword(")")) {
+                return nullptr;
+            }
+            return node;
+        }
+
+        if (position >= tokens.size()) {
+            fail("expected a comparison after '" + node->field + "'");
+            return nullptr;
+        }
+        node->op = toUpper(tokens[position++]);
+        if (node->op == "==") {
+            node->op = "=";
+        }
+        if (node->op != "=" && node->op != "!=" && node->op != "<" && node->op != "<="
+            && node->op != ">" && node->op != ">=" && node->op != "CONTAINS") {
+            fail("unknown comparison '" + node->op + "'");
+            return nullptr;
+        }
+
+        string value;
+        if (!readValue(value)) {
+            return nullptr;
+        }
+        node->values.push_back(value);
+        return node;
+    }
+};
+
+// Parse a whole non-negative number. Returns false if the text is not one.
+bool parseQueryNumber(const string& text, uint32_t& value) {
+    if (text.empty() || text.size() > 9) {
+        return false;
+    }
+    value = 0;
+    for (char c : text) {
+        if (!isdigit(static_cast<unsigned char>(c))) {
+            return false;
+        }
+        value = value * 10 + static_cast<uint32_t>(c - '0');
+    }
+    return true;
+}
+
+// Build a predicate comparing a numeric value against a constant.
+template <typename ReadValue>
+QueryPredicate compileNumberComparison(const string& op, uint32_t constant, ReadValue read) {
+    if (op == "=") {
+        return [=](size_t id) { return read(id) == constant; };
+    }
+    if (op == "!=") {
+        return [=](size_t id) { return read(id) != constant; };
+    }
+    if (op == "<") {
+        return [=](size_t id) { return read(id) < constant; };
+    }
+    if (op == "<=") {
+        return [=](size_t id) { return read(id) <= constant; };
+    }
+    if (op == ">") {
+        return [=](size_t id) { return read(id) > constant; };
+    }
+    return [=](size_t id) { return read(id) >= constant; };
+}
+
+// Compile a parsed query against the index. Returns an empty predicate
+// and sets error if the query cannot be applied.
+QueryPredicate compileQuery(const QueryNode& node, const CatalogIndex& index, string& error) {
+    const CatalogIndex* catalog = &index;
+
+    switch (node.kind) {
+    case QueryNode::And:
+    case QueryNode::Or: {
+        QueryPredicate left = compileQuery(*node.left, index, error);
+        QueryPredicate right = compileQuery(*node.right, index, error);
+        if (!left || !right) {
+            return nullptr;
+        }
+        if (node.kind == QueryNode::And) {
+            return [left, right](size_t id) { return left(id) && right(id); };
+        }
+        return [left, right](size_t id) { return left(id) || right(id); };
+    }
+
+    case QueryNode::Not: {
+        QueryPredicate operand = compileQuery(*node.left, index, error);
+        if (!operand) {
+            return nullptr;
+        }
+        return [operand](size_t id) { return !operand(id); };
+    }
+
+    case QueryNode::HasPrerequisites:
+        return [catalog](size_t id) { return catalog->prereqCount[id] != 0; };
+
+    case QueryNode::Compare:
+    case QueryNode::InList:
+        break;
+    }
+
+    // Departments and campuses are matched through a table indexed by ID
+    // that is filled in here, so evaluation never compares strings.
+    if (node.field == "DEPARTMENT" || node.field == "CAMPUS") {
+        bool isDepartment = node.field == "DEPARTMENT";
+        if (node.kind == QueryNode::Compare && node.op != "=" && node.op != "!=") {
+            error = string(isDepartment ? "department" : "campus") + " only supports =, != and in";
+            return nullptr;
+        }
+        const vector<string>& names = isDepartment ? index.departmentNames : index.campusNames;
+        vector<bool> matches(names.size(), false);
+        for (const string& value : node.values) {
+            string wanted = toUpper(value);
+            for (size_t d = 0; d < names.size(); ++d) {
+                if (names[d] == wanted) {
+                    matches[d] = true;
+                }
+            }
+        }
+        if (node.op == "!=") {
+            matches.flip();
+        }
+        if (isDepartment) {
+            return [catalog, matches](size_t id) { return matches[catalog->department[id]]; };
+        }
+        return [catalog, matches](size_t id) { return matches[catalog->campus[id]]; };
+    }
+
+    // Terms are compared as bit masks.
+    if (node.field == "TERMS") {
+        uint8_t wanted = 0;
+        for (const string& value : node.values) {
+            uint8_t terms;
+            if (!parseTermList(value, terms) || terms == 0) {
+                error = "'" + value + "' is not a list of terms";
+                return nullptr;
+            }
+            wanted |= terms;
+        }
+        if (node.kind == QueryNode::InList || node.op == "CONTAINS") {
+            return [catalog, wanted](size_t id) { return (catalog->termsOffered[id] & wanted) != 0; };
+        }
+        if (node.op == "=" || node.op == "!=") {
+            bool equal = node.op == "=";
+            return [catalog, wanted, equal](size_t id) {
+                return (catalog->termsOffered[id] == wanted) == equal;
+            };
+        }
+        error = "terms only supports =, !=, in and contains";
+        return nullptr;
+    }
+
+    if (node.field == "TITLE") {
+        string wanted = toUpper(node.values[0]);
+        if (node.kind == QueryNode::InList) {
+            error = "title only supports =, != and contains";
+            return nullptr;
+        }
+        if (node.op == "CONTAINS") {
+            return [catalog, wanted](size_t id) {
+                return toUpper(catalog->courses[id]->courseTitle).find(wanted) != string::npos;
+            };
+        }
+        if (node.op == "=" || node.op == "!=") {
+            bool equal = node.op == "=";
+            return [catalog, wanted, equal](size_t id) {
+                return (toUpper(catalog->courses[id]->courseTitle) == wanted) == equal;
+            };
+        }
+        error = "title only supports =, != and contains";
+        return nullptr;
+    }
+
+    // The remaining fields are numeric.
+    vector<uint32_t> constants;
+    for (const string& value : node.values) {
+        uint32_t constant;
+        if (!parseQueryNumber(value, constant)) {
+            error = "'" + value + "' is not a number";
+            return nullptr;
+        }
+        constants.push_back(constant);
+    }
+    if (node.op == "CONTAINS") {
+        error = "contains only applies to title";
+        return nullptr;
+    }
+
+    if (node.kind == QueryNode::InList) {
+        function<uint32_t(size_t)> read;
+        if (node.field == "NUMBER") {
+            read = [catalog](size_t id) { return catalog->number[id]; };
+        }
+        else if (node.field == "LEVEL") {
+            read = [catalog](size_t id) { return catalog->number[id] / 100 * 100; };
+        }
+        else if (node.field == "CREDITS") {
+            read = [catalog](size_t id) { return static_cast<uint32_t>(catalog->creditHours[id]); };
+        }
+        else {
+            read = [catalog](size_t id) { return static_cast<uint32_t>(catalog->prereqCount[id]); };
+        }
+        return [read, constants](size_t id) {
+            uint32_t value = read(id);
+            return find(constants.begin(), constants.end(), value) != constants.end();
+        };
+    }
+
+    // Specialize the common fields so the comparison reads the column directly.
+    if (node.field == "NUMBER") {
+        return compileNumberComparison(node.op, constants[0],
+                                       [catalog](size_t id) { return catalog->number[id]; });
+    }
+    if (node.field == "LEVEL") {
+        return compileNumberComparison(node.op, constants[0], [catalog](size_t id) {
+            return catalog->number[id] / 100 * 100;
+        });
+    }
+    if (node.field == "CREDITS") {
+        return compileNumberComparison(node.op, constants[0], [catalog](size_t id) {
+            return static_cast<uint32_t>(catalog->creditHours[id]);
+        });
+    }
+    return compileNumberComparison(node.op, constants[0], [catalog](size_t id) {
+        return static_cast<uint32_t>(catalog->prereqCount[id]);
+    });
+}
+
+// Parse and compile a query. Returns an empty predicate on error.
+QueryPredicate prepareQuery(const string& text, const CatalogIndex& index, string& error) {
+    QueryParser parser;
+    unique_ptr<QueryNode> node = parser.parse(text, error);
+    if (!node) {
+        return nullptr;
+    }
+    return compileQuery(*node, index, error);
+}
+
+// Evaluate a compiled query over every course and return the matching IDs.
+vector<size_t> runQuery(const QueryPredicate& predicate, const CatalogIndex& index) {
+    vector<size_t> matches;
+    size_t count = index.size();
+    for (size_t id = 0; id < count; ++id) {
+        if (predicate(id)) {
+            matches.push_back(id);
+        }
+    }
+    return matches;
+}
+
+// -----------------------------
+// Catalog totals
+// -----------------------------
+
+// Registrar totals for the whole catalog, grouped by department ID and by
+// level. Levels are the hundreds digit of the course number, with level 9
+// also holding anything numbered 1000 or higher.
+struct CatalogTotals {
+    static constexpr size_t levelCount = 10;
+
+    vector<uint64_t> creditHours;       // department ID -> total credit hours
+    vector<uint32_t> courses;           // department ID -> courses
+    vector<uint32_t> noPrerequisites;   // department ID -> courses with no prerequisites
+    uint32_t coursesPerLevel[levelCount] = {};
+
+    explicit CatalogTotals(size_t departmentCount = 0)
+        : creditHours(departmentCount, 0), courses(departmentCount, 0),
+          noPrerequisites(departmentCount, 0) {}
+
+    void add(const CatalogTotals& other) {
+        for (size_t d = 0; d < courses.size(); ++d) {
+            creditHours[d] += other.creditHours[d];
+            courses[d] += other.courses[d];
+            noPrerequisites[d] += other.noPrerequisites[d];
+        }
+        for (size_t level = 0; level < levelCount; ++level) {
+            coursesPerLevel[level] += other.coursesPerLevel[level];
+        }
+    }
+};
+
+// Compute the totals in one pass over the index columns. Each worker
+// thread totals its own block of courses into private counters with no
+// branches in the loop, and the blocks are added together at the end.
+void computeCatalogTotals(const CatalogIndex& index, CatalogTotals& totals) {
+    size_t departmentCount = index.departmentNames.size();
+    totals = CatalogTotals(departmentCount);
+    mutex totalsGuard;
+
+    parallelFor(index.size(), [&](size_t begin, size_t end) {
+        CatalogTotals block(departmentCount);
+        const uint16_t* department = index.department.data();
+        const uint8_t* credits = index.creditHours.data();
+        const uint16_t* prereqCount = index.prereqCount.data();
+        const uint32_t* number = index.number.data();
+        for (size_t id = begin; id < end; ++id) {
+            uint16_t d = department[id];
+            block.creditHours[d] += credits[id];
+            block.courses[d]++;
+            block.noPrerequisites[d] += prereqCount[id] == 0;
+            block.coursesPerLevel[min<uint32_t>(number[id] / 100, CatalogTotals::levelCount - 1)]++;
+        }
+
+        lock_guard<mutex> lock(totalsGuard);
+        totals.add(block);
+    }, 65536);
+}
+
+// -----------------------------
+// Prerequisite graph analysis
+// -----------------------------
+
+// A course and its score in a ranking.
+struct RankedCourse {
+    uint32_t id;
+    double score;
+};
+
+// Rank courses by how much of the catalog depends on them using PageRank
+// on the prerequisite graph. Each course passes its rank on to its
+// prerequisites, so courses that gate a lot of downstream material end up
+// with a high score. Each iteration pulls rank from a course's dependents,
+// which lets every worker thread update its own block of courses without
+// locks.
+vector<double> computePrerequisiteRank(const CatalogIndex& index, int maxIterations = 50,
+                                       double tolerance = 1e-9) {
+    const double damping = 0.85;
+    size_t count = index.size();
+    if (count == 0) {
+        return {};
+    }
+
+    vector<double> rank(count, 1.0 / count);
+    vector<double> nextRank(count);
+    vector<double> share(count);
+
+    for (int iteration = 0; iteration < maxIterations; ++iteration) {
+        // Rank held by courses with no prerequisites is spread evenly.
+        double danglingRank = 0.0;
+        for (size_t id = 0; id < count; ++id) {
+            uint32_t outDegree = index.prereqStart[id + 1] - index.prereqStart[id];
+            if (outDegree == 0) {
+                danglingRank += rank[id];
+                share[id] = 0.0;
+            }
+            else {
+                share[id] = rank[id] / outDegree;
+            }
+        }
+        double base = (1.0 - damping) / count + damping * danglingRank / count;
+
+        vector<double> blockChange(workerThreadCount() + 1, 0.0);
+        atomic<size_t> nextBlock(0);
+        parallelFor(count, [&](size_t begin, size_t end) {
+            double change = 0.0;
+            for (size_t id = begin; id < end; ++id) {
+                double sum = 0.0;
+                for (uint32_t e = index.dependentStart[id]; e < index.dependentStart[id + 1]; ++e) {
+                    sum += share[index.dependentIds[e]];
+                }
+                nextRank[id] = base + damping * sum;
+                change += fabs(nextRank[id] - rank[id]);
+            }
+            blockChange[nextBlock++] = change;
+        });
+
+        rank.swap(nextRank);
+        double totalChange = 0.0;
+        for (double change : blockChange) {
+            totalChange += change;
+        }
+        if (totalChange < tolerance) {
+            break;
+        }
+    }
+    return rank;
+}
+
+// Return the k highest-scoring courses, highest first.
+vector<RankedCourse> topRankedCourses(const vector<double>& scores, size_t k) {
+    vector<RankedCourse> ranked;
+    ranked.reserve(scores.size());
+    for (size_t id = 0; id < scores.size(); ++id) {
+        ranked.push_back({ static_cast<uint32_t>(id), scores[id] });
+    }
+
+    k = min(k, ranked.size());
+    auto higher = [](const RankedCourse& a, const RankedCourse& b) {
+        return a.score != b.score ? a.score > b.score : a.id < b.id;
+    };
+    partial_sort(ranked.begin(), ranked.begin() + k, ranked.end(), higher);
+    ranked.resize(k);
+    return ranked;
+}
+
+// Collect every course that needs the given course, directly or through a
+// chain of prerequisites. Only the courses found are visited, so the cost
+// depends on the size of the answer rather than the size of the catalog.
+unordered_set<uint32_t> collectAllDependents(const CatalogIndex& index, uint32_t courseId) {
+    unordered_set<uint32_t> found;
+    vector<uint32_t> pending = { courseId };
+
+    while (!pending.empty()) {
+        uint32_t id = pending.back();
+        pending.pop_back();
+        for (uint32_t e = index.dependentStart[id]; e < index.dependentStart[id + 1]; ++e) {
+            uint32_t dependent = index.dependentIds[e];
+            if (dependent != courseId && found.insert(dependent).second) {
+                pending.push_back(dependent);
+            }
+        }
+    }
+    return found;
+}
+
+// Count every course that needs the given course, directly or through a
+// chain of prerequisites.
+size_t countAllDependents(const CatalogIndex& index, uint32_t courseId) {
+    return collectAllDependents(index, courseId).size();
+}
+
+// -----------------------------
+// Curriculum levels
+// -----------------------------
+
+// Every course placed on a level: level 0 holds the courses with no
+// prerequisites, and every other course sits one level above its highest
+// prerequisite, so a course's level is the length of the longest
+// prerequisite chain leading to it. A course with a prerequisite rule
+// sits one level above the lowest level by which its rule can be
+// satisfied. Courses in or behind a prerequisite cycle get no level.
+struct CurriculumLevels {
+    vector<uint32_t> level;        // course ID -> level, or noCourse
+    vector<uint32_t> courseIds;    // courses grouped by level
+    vector<uint32_t> levelStart;   // level L is courseIds[levelStart[L]] up to courseIds[levelStart[L + 1] - 1]
+
+    size_t levelCount() const {
+        return levelStart.empty() ? 0 : levelStart.size() - 1;
+    }
+};
+
+// Return true if a rule course's rule can be satisfied by the courses
+// already placed on levels up to maxLevel.
+bool isRuleSatisfiedByLevel(const CatalogIndex& index, const CurriculumLevels& levels,
+                            uint32_t id, uint32_t maxLevel) {
+    uint32_t via;
+    return rulePrerequisiteTerms(index, id, [&levels, maxLevel](uint32_t prereq) {
+        return levels.level[prereq] <= maxLevel ? 1u : 0u;
+    }, via) != CatalogIndex::noCourse;
+}
+
+// Return true if a course with a rule needs no prerequisites at all.
+bool hasEmptyRule(const CatalogIndex& index, uint32_t id) {
+    return index.ruleStart[id] == index.ruleStart[id + 1];
+}
+
+// Place the courses on levels with Kahn's algorithm, one level at a time:
+// the courses on a level are the ones whose last prerequisite was on the
+// level before it. A rule course is checked each time one of the courses
+// it names is placed, and goes on the next level the first time its rule
+// can be satisfied by the levels finished so far.
+void computeCurriculumLevelsSequential(const CatalogIndex& index, CurriculumLevels& levels) {
+    size_t count = index.size();
+    levels.level.assign(count, CatalogIndex::noCourse);
+    levels.courseIds.clear();
+    levels.courseIds.reserve(count);
+    levels.levelStart.assign(1, 0);
+
+    vector<uint32_t> remaining(count);
+    for (size_t id = 0; id < count; ++id) {
+        remaining[id] = index.prereqStart[id + 1] - index.prereqStart[id];
+        bool hasRule = (index.prereqFlags[id] & CatalogIndex::prereqHasRule) != 0;
+        if (hasRule ? hasEmptyRule(index, static_cast<uint32_t>(id)) : remaining[id] == 0) {
+            levels.level[id] = 0;
+            levels.courseIds.push_back(static_cast<uint32_t>(id));
+        }
+    }
+
+    size_t levelBegin = 0;
+    while (levelBegin < levels.courseIds.size()) {
+        size_t levelEnd = levels.courseIds.size();
+        levels.levelStart.push_back(static_cast<uint32_t>(levelEnd));
+        uint32_t nextLevel = static_cast<uint32_t>(levels.levelStart.size() - 1);
+
+        for (size_t i = levelBegin; i < levelEnd; ++i) {
+            uint32_t id = levels.courseIds[i];
+            for (uint32_t e = index.dependentStart[id]; e < index.dependentStart[id + 1]; ++e) {
+                uint32_t dependent = index.dependentIds[e];
+                bool ready = index.prereqFlags[dependent] & CatalogIndex::prereqHasRule
+                                 ? levels.level[dependent] == CatalogIndex::noCourse
+                                       && isRuleSatisfiedByLevel(index, levels, dependent,
+                                                                 nextLevel - 1)
+                                 : --remaining[dependent] == 0;
+                if (ready) {
+                    levels.level[dependent] = nextLevel;
+                    levels.courseIds.push_back(dependent);
+                }
+            }
+        }
+        levelBegin = levelEnd;
+    }
+}
+
+// The same layering with each level's courses shared among worker
+// threads. The threads are started once and wait for each other at the
+// end of every level. Remaining-prerequisite counts are atomic, so the
+// thread that brings a course's count to zero is the one that places it
+// on the next level. Each thread collects the courses it places in a
+// small buffer and reserves room for them at the end of courseIds with
+// one atomic add. Rule courses are only noted as candidates during a
+// level; the last thread to reach the barrier checks their rules and
+// places them, so a rule is never read while levels are being written.
+// The order of courses within a level is not fixed. Small catalogs and
+// single-core machines use the sequential version.
+void computeCurriculumLevels(const CatalogIndex& index, CurriculumLevels& levels,
+                             size_t threadCount = workerThreadCount()) {
+    size_t count = index.size();
+    threadCount = max<size_t>(1, min(threadCount, count / 4096));
+    if (threadCount == 1) {
+        computeCurriculumLevelsSequential(index, levels);
+        return;
+    }
+    levels.level.assign(count, CatalogIndex::noCourse);
+    levels.courseIds.assign(count, 0);
+    levels.levelStart.assign(1, 0);
+
+    unique_ptr<atomic<uint32_t>[]> remaining(new atomic<uint32_t>[count]);
+    atomic<size_t> tail(0);        // end of the courses placed so far
+    atomic<size_t> cursor(0);      // next course on the current level to claim
+    size_t levelBegin = 0;         // bounds of the current level, changed
+    size_t levelEnd = 0;           // only between levels
+    uint32_t nextLevel = 1;
+    const size_t grain = 256;
+    vector<vector<uint32_t>> ruleCandidates(threadCount);
+
+    ThreadBarrier barrier(threadCount);
+    auto placeRuleCourses = [&]() {
+        for (vector<uint32_t>& candidates : ruleCandidates) {
+            for (uint32_t id : candidates) {
+                if (levels.level[id] == CatalogIndex::noCourse
+                    && isRuleSatisfiedByLevel(index, levels, id, nextLevel - 1)) {
+                    levels.level[id] = nextLevel;
+                    levels.courseIds[tail++] = id;
+                }
+            }
+            candidates.clear();
+        }
+    };
+    auto finishLevel = [&]() {
+        levelBegin = levels.levelStart.back();
+        levelEnd = tail;
+        cursor = levelBegin;
+        if (levelEnd > levels.levelStart.back()) {
+            levels.levelStart.push_back(static_cast<uint32_t>(levelEnd));
+        }
+    };
+
+    auto worker = [&](size_t t) {
+        vector<uint32_t> placed;
+        placed.reserve(grain);
+        auto flush = [&]() {
+            size_t position = tail.fetch_add(placed.size());
+            copy(placed.begin(), placed.end(), levels.courseIds.begin() + position);
+            placed.clear();
+        };
+
+        // Count each course's prerequisites and place the courses with
+        // none on level 0.
+        size_t blockSize = (count + threadCount - 1) / threadCount;
+        for (size_t id = t * blockSize; id < min(count, (t + 1) * blockSize); ++id) {
+            uint32_t prereqs = index.prereqStart[id + 1] - index.prereqStart[id];
+            remaining[id].store(prereqs, memory_order_relaxed);
+            bool hasRule = (index.prereqFlags[id] & CatalogIndex::prereqHasRule) != 0;
+            if (hasRule ? hasEmptyRule(index, static_cast<uint32_t>(id)) : prereqs == 0) {
+                levels.level[id] = 0;
+                placed.push_back(static_cast<uint32_t>(id));
+                if (placed.size() == grain) {
+                    flush();
+                }
+            }
+        }
+        flush();
+        barrier.arriveAndWait(finishLevel);
+
+        while (levelBegin < levelEnd) {
+            uint32_t level = nextLevel;
+            for (size_t begin = cursor.fetch_add(grain); begin < levelEnd;
+                 begin = cursor.fetch_add(grain)) {
+                for (size_t i = begin; i < min(levelEnd, begin + grain); ++i) {
+                    uint32_t id = levels.courseIds[i];
+                    for (uint32_t e = index.dependentStart[id]; e < index.dependentStart[id + 1]; ++e) {
+                        uint32_t dependent = index.dependentIds[e];
+                        if (index.prereqFlags[dependent] & CatalogIndex::prereqHasRule) {
+                            // Levels of rule courses only change at the
+                            // barrier, so this read does not race.
+                            if (levels.level[dependent] == CatalogIndex::noCourse) {
+                                ruleCandidates[t].push_back(dependent);
+                            }
+                        }
+                        else if (remaining[dependent].fetch_sub(1, memory_order_acq_rel) == 1) {
+                            levels.level[dependent] = level;
+                            placed.push_back(dependent);
+                            if (placed.size() == grain) {
+                                flush();
+                            }
+                        }
+                    }
+                }
+            }
+            flush();
+            barrier.arriveAndWait([&]() {
+                placeRuleCourses();
+                finishLevel();
+                nextLevel++;
+            });
+        }
+    };
+
+    vector<thread> workers;
+    for (size_t t = 1; t < threadCount; ++t) {
+        workers.emplace_back(worker, t);
+    }
+    worker(0);
+    for (thread& thread : workers) {
+        thread.join();
+    }
+    levels.courseIds.resize(tail);
+}
+
+// -----------------------------
+// Course eligibility
+// -----------------------------
+
+// A set of completed courses as one bit per course ID.
+using CourseBitmap = vector<uint64_t>;
+
+// Make an empty bitmap sized for the catalog.
+CourseBitmap makeCourseBitmap(const CatalogIndex& index) {
+    return CourseBitmap((index.size() + 63) / 64, 0);
+}
+
+// Index of the lowest set bit of a non-zero word.
+inline int countTrailingZeros(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
+    while ((word & 1) == 0) {
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+// Number of set bits in a word.
+inline int countSetBits(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(word);
+#else
+    int count = 0;
+    for (; word != 0; word &= word - 1) {
+        count++;
+    }
+    return count;
+#endif
+}
+
+inline void setCourseBit(CourseBitmap& bitmap, uint32_t id) {
+    bitmap[id / 64] |= uint64_t(1) << (id % 64);
+}
+
+inline bool testCourseBit(const CourseBitmap& bitmap, uint32_t id) {
+    return (bitmap[id / 64] >> (id % 64)) & 1;
+}
+
+// Run a course's rule program. completedMask(id) returns a 64-bit word
+// for a course: all ones or zero when checking one student, or one bit
+// per student when checking a bit-sliced batch, so the same program
+// answers up to 64 students at once. A course without a rule returns all
+// ones.
+template <typename CompletedMask>
+inline uint64_t runPrerequisiteRule(const CatalogIndex& index, uint32_t id,
+                                    CompletedMask completedMask) {
+    uint32_t first = index.ruleStart[id];
+    uint32_t last = index.ruleStart[id + 1];
+    if (first == last) {
+        return ~uint64_t(0);
+    }
+
+    // The first slot is set so the compiler can see the result is always
+    // written; a compiled program pushes before it reads.
+    uint64_t stack[maxRuleStackDepth];
+    stack[0] = 0;
+    size_t depth = 0;
+    for (uint32_t pc = first; pc < last; ++pc) {
+        uint32_t instruction = index.ruleCode[pc];
+        switch (instruction & CatalogIndex::ruleOpMask) {
+        case CatalogIndex::rulePush:
+            stack[depth++] = completedMask(instruction & ~CatalogIndex::ruleOpMask);
+            break;
+        case CatalogIndex::ruleFalse:
+            stack[depth++] = 0;
+            break;
+        case CatalogIndex::ruleAnd:
+            depth--;
+            stack[depth - 1] &= stack[depth];
+            break;
+        default:
+            depth--;
+            stack[depth - 1] |= stack[depth];
+            break;
+        }
+    }
+    return stack[0];
+}
+
+// Return true if every prerequisite of the course is in the completed set.
+// Each mask entry checks up to 64 prerequisites with one AND and compare.
+// The checks are combined without branching because whether a student has
+// a prerequisite is close to random from the CPU's point of view.
+inline bool prerequisitesSatisfied(const CatalogIndex& index, uint32_t id,
+                                   const CourseBitmap& completed) {
+    const uint32_t* words = index.prereqMaskWord.data();
+    const uint64_t* masks = index.prereqMaskBits.data();
+    uint32_t e = index.prereqMaskStart[id];
+    uint32_t end = index.prereqMaskStart[id + 1];
+    uint8_t flags = index.prereqFlags[id];
+    uint64_t missing = flags & CatalogIndex::prereqMissing;
+
+    // Every course has at least two entries, so the common cases need no
+    // loop and the CPU has no loop count to mispredict.
+    missing |= masks[e] & ~completed[words[e]];
+    missing |= masks[e + 1] & ~completed[words[e + 1]];
+    for (e += 2; e < end; ++e) {
+        missing |= masks[e] & ~completed[words[e]];
+    }
+
+    // Rules are rare, so this branch is well predicted, while testing
+    // missing first would not be.
+    if ((flags & CatalogIndex::prereqHasRule) == 0) {
+        return missing == 0;
+    }
+    return runPrerequisiteRule(index, id, [&completed](uint32_t prereq) {
+        return testCourseBit(completed, prereq) ? ~uint64_t(0) : uint64_t(0);
+    }) != 0;
+}
+
+// Fill eligible with the IDs of every course not yet completed whose
+// prerequisites are all in the completed set. The scan works a 64-bit
+// word at a time and only visits courses whose bit is clear in the
+// completed set. Passing the same vector for many students reuses its
+// memory.
+void findEligibleCourses(const CatalogIndex& index, const CourseBitmap& completed,
+                         vector<uint32_t>& eligible) {
+    eligible.resize(index.size());
+    size_t found = 0;
+    size_t count = index.size();
+    for (size_t w = 0; w < completed.size(); ++w) {
+        uint64_t candidates = ~completed[w];
+        if (w == completed.size() - 1 && count % 64 != 0) {
+            candidates &= (uint64_t(1) << (count % 64)) - 1;
+        }
+        while (candidates != 0) {
+            uint32_t id = static_cast<uint32_t>(w * 64 + countTrailingZeros(candidates));
+            candidates &= candidates - 1;
+            // Always write the ID and only keep it if the course is eligible.
+            eligible[found] = id;
+            found += prerequisitesSatisfied(index, id, completed);
+        }
+    }
+    eligible.resize(found);
+}
+
+// -----------------------------
+// What-if analysis
+// -----------------------------
+
+// A hypothetical edit to one course: either retiring it or replacing its
+// prerequisites with an all-required list.
+struct WhatIfChange {
+    uint32_t courseId = CatalogIndex::noCourse;
+    bool removeCourse = false;
+    vector<uint32_t> newPrereqs;
+    bool newPrereqMissing = false;   // a new prerequisite is not in the catalog
+};
+
+// How a course's minimum number of terms changes.
+struct ChainChange {
+    uint32_t id;
+    uint32_t oldTerms;
+    uint32_t newTerms;
+};
+
+// The courses affected by a hypothetical change.
+struct WhatIfImpact {
+    bool createsCycle = false;
+    size_t coursesVisited = 0;
+    vector<uint32_t> blocked;            // could be taken before, not after
+    vector<uint32_t> stillAvailable;     // depend on the course but are still takeable
+    vector<ChainChange> chainChanges;    // takeable before and after, different length
+};
+
+// Return true if a course could be taken before any change: it is not in
+// or behind a cycle and it does not list a course missing from the catalog.
+inline bool isTakeable(const CatalogIndex& index, uint32_t id) {
+    return index.chainLength[id] != 0
+           && (index.prereqFlags[id] & CatalogIndex::prereqMissing) == 0;
+}
+
+// Work out which courses a change breaks or lengthens. Only the courses
+// downstream of the changed course are visited: they are put in
+// topological order among themselves and re-evaluated once each, using
+// the stored results for every course outside that set. Prerequisite
+// rules are honored, so a course that still has an alternative is not
+// reported as blocked.
+WhatIfImpact analyzeWhatIf(const CatalogIndex& index, const WhatIfChange& change) {
+    WhatIfImpact impact;
+    uint32_t changed = change.courseId;
+    unordered_set<uint32_t> downstream = collectAllDependents(index, changed);
+    impact.coursesVisited = downstream.size() + 1;
+
+    // A new prerequisite that already depends on the course would make a cycle.
+    for (uint32_t prereq : change.newPrereqs) {
+        if (prereq == changed || downstream.count(prereq) != 0) {
+            impact.createsCycle = true;
+            return impact;
+        }
+    }
+
+    // New state for the changed course and everything downstream of it.
+    unordered_map<uint32_t, bool> blocked;
+    unordered_map<uint32_t, uint32_t> terms;
+    auto isBlocked = [&](uint32_t id) {
+        auto found = blocked.find(id);
+        return found != blocked.end() ? found->second : !isTakeable(index, id);
+    };
+    auto termsFor = [&](uint32_t id) {
+        auto found = terms.find(id);
+        return found != terms.end() ? found->second : index.chainLength[id];
+    };
+
+    if (change.removeCourse) {
+        blocked[changed] = true;
+        terms[changed] = 0;
+    }
+    else {
+        bool changedBlocked = change.newPrereqMissing;
+        uint32_t longest = 0;
+        for (uint32_t prereq : change.newPrereqs) {
+            changedBlocked = changedBlocked || isBlocked(prereq);
+            longest = max(longest, termsFor(prereq));
+        }
+        blocked[changed] = changedBlocked;
+        terms[changed] = changedBlocked ? 0 : longest + 1;
+    }
+
+    // Count each downstream course's prerequisites that are also
+    // downstream (or the changed course), then run Kahn's algorithm over
+    // just that part of the graph.
+    unordered_map<uint32_t, uint32_t> remaining;
+    for (uint32_t id : downstream) {
+        uint32_t count = 0;
+        for (uint32_t e = index.prereqStart[id]; e < index.prereqStart[id + 1]; ++e) {
+            uint32_t prereq = index.prereqIds[e];
+            if (prereq == changed || downstream.count(prereq) != 0) {
+                count++;
+            }
+        }
+        remaining[id] = count;
+    }
+
+    vector<uint32_t> ready = { changed };
+    while (!ready.empty()) {
+        uint32_t id = ready.back();
+        ready.pop_back();
+
+        if (id != changed) {
+            bool courseBlocked;
+            if (index.prereqFlags[id] & CatalogIndex::prereqHasRule) {
+                courseBlocked = runPrerequisiteRule(index, id, [&](uint32_t prereq) {
+                    return isBlocked(prereq) ? uint64_t(0) : ~uint64_t(0);
+                }) == 0;
+            }
+            else {
+                courseBlocked = (index.prereqFlags[id] & CatalogIndex::prereqMissing) != 0;
+                for (uint32_t e = index.prereqStart[id]; e < index.prereqStart[id + 1]; ++e) {
+                    courseBlocked = courseBlocked || isBlocked(index.prereqIds[e]);
+                }
+            }
+
+            // A rule needs only its shortest alternative.
+            uint32_t longest = 0;
+            if (index.prereqFlags[id] & CatalogIndex::prereqHasRule) {
+                uint32_t via;
+                longest = rulePrerequisiteTerms(index, id, [&](uint32_t prereq) {
+                    return isBlocked(prereq) ? 0 : termsFor(prereq);
+                }, via);
+            }
+            else {
+                for (uint32_t e = index.prereqStart[id]; e < index.prereqStart[id + 1]; ++e) {
+                    longest = max(longest, termsFor(index.prereqIds[e]));
+                }
+            }
+            blocked[id] = courseBlocked;
+            terms[id] = courseBlocked ? 0 : longest + 1;
+        }
+
+        for (uint32_t e = index.dependentStart[id]; e < index.dependentStart[id + 1]; ++e) {
+            uint32_t dependent = index.dependentIds[e];
+            auto count = remaining.find(dependent);
+            if (count != remaining.end() && --count->second == 0) {
+                ready.push_back(dependent);
+            }
+        }
+    }
+
+    // Courses never reached are in a cycle, and so were not takeable
+    // before the change either.
+    vector<uint32_t> region(downstream.begin(), downstream.end());
+    region.push_back(changed);
+    sort(region.begin(), region.end());
+    for (uint32_t id : region) {
+        if (blocked.count(id) == 0 || !isTakeable(index, id)) {
+            continue;
+        }
+        if (blocked[id]) {
+            if (id != changed || !change.removeCourse) {
+                impact.blocked.push_back(id);
+            }
+        }
+        else {
+            if (id != changed) {
+                impact.stillAvailable.push_back(id);
+            }
+            if (terms[id] != index.chainLength[id]) {
+                impact.chainChanges.push_back({ id, index.chainLength[id], terms[id] });
+            }
+        }
+    }
+    return impact;
+}
+
+// -----------------------------
+// Transitive prerequisite closure
+// -----------------------------
+
+// For every course, the set of all courses it requires directly or
+// through a chain of prerequisites, stored as one bit row per course.
+// For a course with a prerequisite rule, only courses needed by every
+// way of satisfying the rule count: AND joins the sets of its terms and
+// OR keeps the courses common to the alternatives that can be taken.
+// Unlike CatalogIndex, which is rebuilt from scratch after a load, this
+// index is kept up to date through single-course edits: an edit only
+// recomputes the edited course and the courses downstream of it, in
+// topological order. If an edit reaches more than a set fraction of the
+// catalog, a full rebuild is cheaper and is used instead.
+//
+// Courses keep the same slot for as long as they exist, so edits never
+// renumber anything. Rows take courses * courses / 8 bytes, which suits
+// catalogs up to a few tens of thousands of courses.
+class PrerequisiteClosure {
+public:
+    // Build the closure for every course in the catalog index.
+    void build(const CatalogIndex& index) {
+        clear();
+        sourceHash = index.sourceHash;
+        for (size_t id = 0; id < index.size(); ++id) {
+            allocateSlot(index.courses[id]->courseNumber);
+        }
+        for (size_t id = 0; id < index.size(); ++id) {
+            for (const string& alias : index.courses[id]->aliases) {
+                aliasTarget[alias] = index.courses[id]->courseNumber;
+            }
+        }
+        for (size_t id = 0; id < index.size(); ++id) {
+            linkPrerequisites(static_cast<uint32_t>(id), index.courses[id]->prerequisites,
+                              index.courses[id]->prerequisiteRule);
+        }
+        rebuildAll();
+    }
+
+    void clear() {
+        nodes.clear();
+        freeSlots.clear();
+        slotByNumber.clear();
+        aliasTarget.clear();
+        waitingFor.clear();
+        rows.clear();
+        rowWords = 1;
+        liveCount = 0;
+        sourceHash = 0;
+    }
+
+    // Add a course. rule is its prerequisite rule, or empty if every
+    // prerequisite is required. Returns false if the course already
+    // exists or the change would create a prerequisite cycle.
+    bool insertCourse(const string& number, const vector<string>& prereqs, const string& rule) {
+        if (slotByNumber.count(number) != 0) {
+            return false;
+        }
+
+        // Courses that already list this number as a prerequisite will
+        // depend on it, so none of the new prerequisites may depend on them.
+        vector<uint32_t> waiting;
+        auto found = waitingFor.find(number);
+        if (found != waitingFor.end()) {
+            waiting = found->second;
+        }
+        vector<uint32_t> downstream = collectDownstream(waiting);
+        for (const string& prereq : prereqs) {
+            uint32_t slot = findSlot(prereq);
+            if (slot != noSlot && isMarked(slot)) {
+                return false;
+            }
+        }
+
+        uint32_t slot = allocateSlot(number);
+        if (found != waitingFor.end()) {
+            for (uint32_t dependent : waiting) {
+                vector<string>& unknown = nodes[dependent].unknownPrereqs;
+                unknown.erase(remove(unknown.begin(), unknown.end(), number), unknown.end());
+                addEdge(dependent, slot);
+            }
+            waitingFor.erase(number);
+        }
+        linkPrerequisites(slot, prereqs, rule);
+        updateFrom({ slot });
+        return true;
+    }
+
+    // Replace a course's prerequisites and rule. Returns false if the
+    // course does not exist or the change would create a prerequisite
+    // cycle.
+    bool setPrerequisites(const string& number, const vector<string>& prereqs,
+                          const string& rule) {
+        uint32_t slot = findSlot(number);
+        if (slot == noSlot) {
+            return false;
+        }
+
+        collectDownstream({ slot });
+        for (const string& prereq : prereqs) {
+            uint32_t prereqSlot = findSlot(prereq);
+            if (prereqSlot != noSlot && isMarked(prereqSlot)) {
+                return false;
+            }
+        }
+
+        unlinkPrerequisites(slot);
+        linkPrerequisites(slot, prereqs, rule);
+        updateFrom({ slot });
+        return true;
+    }
+
+    // Remove a course. Courses that listed it keep the number as an
+    // unknown prerequisite, the same as a prerequisite missing from the
+    // file. Returns false if the course does not exist.
+    bool removeCourse(const string& number) {
+        uint32_t slot = findSlot(number);
+        if (slot == noSlot || nodes[slot].number != number) {
+            return false;
+        }
+
+        vector<uint32_t> dependents = nodes[slot].dependents;
+        for (uint32_t dependent : dependents) {
+            vector<uint32_t>& prereqs = nodes[dependent].prereqs;
+            prereqs.erase(remove(prereqs.begin(), prereqs.end(), slot), prereqs.end());
+            nodes[dependent].unknownPrereqs.push_back(number);
+            waitingFor[number].push_back(dependent);
+        }
+        unlinkPrerequisites(slot);
+
+        fill(rowOf(slot), rowOf(slot) + rowWords, 0);
+        slotByNumber.erase(number);
+        for (auto alias = aliasTarget.begin(); alias != aliasTarget.end();) {
+            alias = alias->second == number ? aliasTarget.erase(alias) : next(alias);
+        }
+        nodes[slot] = Node();
+        freeSlots.push_back(slot);
+        liveCount--;
+
+        updateFrom(dependents);
+        return true;
+    }
+
+    // Return true if course requires prereq, directly or indirectly.
+    bool dependsOn(const string& course, const string& prereq) const {
+        uint32_t courseSlot = findSlot(course);
+        uint32_t prereqSlot = findSlot(prereq);
+        if (courseSlot == noSlot || prereqSlot == noSlot) {
+            return false;
+        }
+        return (rowOf(courseSlot)[prereqSlot / 64] >> (prereqSlot % 64)) & 1;
+    }
+
+    // Every course the given course requires, sorted by course number.
+    vector<string> allPrerequisites(const string& number) const {
+        vector<string> result;
+        uint32_t slot = findSlot(number);
+        if (slot == noSlot) {
+            return result;
+        }
+        const uint64_t* row = rowOf(slot);
+        for (size_t w = 0; w < rowWords; ++w) {
+            for (uint64_t bits = row[w]; bits != 0; bits &= bits - 1) {
+                result.push_back(nodes[w * 64 + countTrailingZeros(bits)].number);
+            }
+        }
+        sort(result.begin(), result.end());
+        return result;
+    }
+
+    size_t size() const {
+        return liveCount;
+    }
+
+    uint64_t getSourceHash() const {
+        return sourceHash;
+    }
+
+    void setSourceHash(uint64_t hash) {
+        sourceHash = hash;
+    }
+
+    // Number of courses recomputed by the last edit, and whether it fell
+    // back to a full rebuild.
+    size_t lastCoursesUpdated() const {
+        return lastUpdated;
+    }
+
+    bool lastEditRebuilt() const {
+        return lastRebuilt;
+    }
+
+    // Edits that reach more than this fraction of the catalog rebuild it.
+    double rebuildFraction = 0.25;
+
+private:
+    static constexpr uint32_t noSlot = UINT32_MAX;
+
+    struct Node {
+        string number;
+        vector<uint32_t> prereqs;        // every course named, required or not
+        vector<uint32_t> dependents;
+        vector<string> unknownPrereqs;   // numbers not (yet) in the catalog
+        vector<string> rule;             // postfix; empty if all prereqs are required
+        bool takeable = false;           // the prerequisites can be completed
+        bool live = false;
+    };
+
+    vector<Node> nodes;
+    vector<uint32_t> freeSlots;
+    unordered_map<string, uint32_t> slotByNumber;
+    unordered_map<string, string> aliasTarget;          // alias -> course number
+    unordered_map<string, vector<uint32_t>> waitingFor; // unknown number -> slots listing it
+    vector<uint64_t> rows;
+    size_t rowWords = 1;
+    size_t liveCount = 0;
+    uint64_t sourceHash = 0;
+    size_t lastUpdated = 0;
+    bool lastRebuilt = false;
+
+    // Scratch marks for the courses reached by the current edit. A mark
+    // is current when it equals markEpoch, so clearing them is free.
+    vector<uint32_t> marks;
+    uint32_t markEpoch = 0;
+
+    // Scratch space for computeRow: the new row and, while a rule is
+    // evaluated, one row per stack entry.
+    vector<uint64_t> newRow;
+    vector<uint64_t> ruleRows;
+    vector<char> ruleTakeable;
+
+    uint64_t* rowOf(uint32_t slot) {
+        return rows.data() + slot * rowWords;
+    }
+
+    const uint64_t* rowOf(uint32_t slot) const {
+        return rows.data() + slot * rowWords;
+    }
+
+    bool isMarked(uint32_t slot) const {
+        return marks[slot] == markEpoch;
+    }
+
+    uint32_t findSlot(const string& number) const {
+        auto found = slotByNumber.find(number);
+        if (found != slotByNumber.end()) {
+            return found->second;
+        }
+        auto alias = aliasTarget.find(number);
+        if (alias != aliasTarget.end()) {
+            found = slotByNumber.find(alias->second);
+            if (found != slotByNumber.end()) {
+                return found->second;
+            }
+        }
+        return noSlot;
+    }
+
+    uint32_t allocateSlot(const string& number) {
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            slot = static_cast<uint32_t>(nodes.size());
+            nodes.emplace_back();
+            marks.push_back(0);
+            if (nodes.size() > rowWords * 64) {
+                growRows();
+            }
+            else {
+                rows.resize(nodes.size() * rowWords, 0);
+            }
+        }
+        nodes[slot].number = number;
+        nodes[slot].live = true;
+        slotByNumber[number] = slot;
+        liveCount++;
+        return slot;
+    }
+
+    // Double the row width, copying each existing row.
+    void growRows() {
+        size_t newWords = rowWords * 2;
+        while (nodes.size() > newWords * 64) {
+            newWords *= 2;
+        }
+        vector<uint64_t> newRows(nodes.size() * newWords, 0);
+        for (size_t slot = 0; slot + 1 < nodes.size(); ++slot) {
+            copy(rows.begin() + slot * rowWords, rows.begin() + (slot + 1) * rowWords,
+                 newRows.begin() + slot * newWords);
+        }
+        rows.swap(newRows);
+        rowWords = newWords;
+    }
+
+    void addEdge(uint32_t slot, uint32_t prereq) {
+        if (find(nodes[slot].prereqs.begin(), nodes[slot].prereqs.end(), prereq)
+            == nodes[slot].prereqs.end()) {
+            nodes[slot].prereqs.push_back(prereq);
+            nodes[prereq].dependents.push_back(slot);
+        }
+    }
+
+    void linkPrerequisites(uint32_t slot, const vector<string>& prereqs, const string& rule) {
+        // A rule that does not parse is treated as requiring every course,
+        // the same as a course without one.
+        string error;
+        if (!rule.empty() && !parsePrerequisiteRule(rule, nodes[slot].rule, error)) {
+            nodes[slot].rule.clear();
+        }
+        for (const string& prereq : prereqs) {
+            uint32_t prereqSlot = findSlot(prereq);
+            if (prereqSlot != noSlot) {
+                addEdge(slot, prereqSlot);
+            }
+            else {
+                nodes[slot].unknownPrereqs.push_back(prereq);
+                waitingFor[prereq].push_back(slot);
+            }
+        }
+    }
+
+    void unlinkPrerequisites(uint32_t slot) {
+        for (uint32_t prereq : nodes[slot].prereqs) {
+            vector<uint32_t>& dependents = nodes[prereq].dependents;
+            dependents.erase(remove(dependents.begin(), dependents.end(), slot), dependents.end());
+        }
+        for (const string& unknown : nodes[slot].unknownPrereqs) {
+            vector<uint32_t>& waiting = waitingFor[unknown];
+            waiting.erase(remove(waiting.begin(), waiting.end(), slot), waiting.end());
+            if (waiting.empty()) {
+                waitingFor.erase(unknown);
+            }
+        }
+        nodes[slot].prereqs.clear();
+        nodes[slot].unknownPrereqs.clear();
+        nodes[slot].rule.clear();
+    }
+
+    // Mark and return the given courses and everything downstream of them.
+    vector<uint32_t> collectDownstream(const vector<uint32_t>& starts) {
+        markEpoch++;
+        vector<uint32_t> found;
+        for (uint32_t start : starts) {
+            if (!isMarked(start)) {
+                marks[start] = markEpoch;
+                found.push_back(start);
+            }
+        }
+        for (size_t i = 0; i < found.size(); ++i) {
+            for (uint32_t dependent : nodes[found[i]].dependents) {
+                if (!isMarked(dependent)) {
+                    marks[dependent] = markEpoch;
+                    found.push_back(dependent);
+                }
+            }
+        }
+        return found;
+    }
+
+    // Recompute the courses downstream of an edit, or everything if the
+    // edit reaches too much of the catalog.
+    void updateFrom(const vector<uint32_t>& starts) {
+        vector<uint32_t> affected = collectDownstream(starts);
+        if (affected.size() > rebuildFraction * liveCount) {
+            rebuildAll();
+            return;
+        }
+        recompute(affected);
+        lastUpdated = affected.size();
+        lastRebuilt = false;
+    }
+
+    void rebuildAll() {
+        vector<uint32_t> all;
+        for (uint32_t slot = 0; slot < nodes.size(); ++slot) {
+            if (nodes[slot].live) {
+                all.push_back(slot);
+            }
+        }
+        markEpoch++;
+        for (uint32_t slot : all) {
+            marks[slot] = markEpoch;
+        }
+        recompute(all);
+        lastUpdated = all.size();
+        lastRebuilt = true;
+    }
+
+    // Recompute the rows of the marked courses. Each course's row is the
+    // union of its prerequisites' rows plus the prerequisites themselves,
+    // so the courses are visited in topological order among themselves.
+    void recompute(const vector<uint32_t>& affected) {
+        unordered_map<uint32_t, uint32_t> remaining;
+        vector<uint32_t> ready;
+        for (uint32_t slot : affected) {
+            uint32_t count = 0;
+            for (uint32_t prereq : nodes[slot].prereqs) {
+                if (isMarked(prereq)) {
+                    count++;
+                }
+            }
+            remaining[slot] = count;
+            if (count == 0) {
+                ready.push_back(slot);
+            }
+        }
+
+        size_t done = 0;
+        while (!ready.empty()) {
+            uint32_t slot = ready.back();
+            ready.pop_back();
+            done++;
+            computeRow(slot);
+            for (uint32_t dependent : nodes[slot].dependents) {
+                auto count = remaining.find(dependent);
+                if (count != remaining.end() && --count->second == 0) {
+                    ready.push_back(dependent);
+                }
+            }
+        }
+
+        // Courses in a prerequisite cycle never become ready. They start
+        // from every course a plain search reaches, marked as not takeable,
+        // and are recomputed until nothing changes. Rows only shrink and
+        // courses only become takeable, so this ends.
+        if (done < affected.size()) {
+            vector<uint32_t> cycle;
+            for (uint32_t slot : affected) {
+                if (remaining[slot] != 0) {
+                    computeRowBySearch(slot);
+                    nodes[slot].takeable = false;
+                    cycle.push_back(slot);
+                }
+            }
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (uint32_t slot : cycle) {
+                    changed = computeRow(slot) || changed;
+                }
+            }
+        }
+    }
+
+    // Recompute one course's row and takeable flag from its prerequisites.
+    // Returns true if either changed.
+    bool computeRow(uint32_t slot) {
+        const Node& node = nodes[slot];
+        bool takeable;
+        newRow.assign(rowWords, 0);
+        if (node.rule.empty() || !evaluateRule(node.rule, newRow.data(), takeable)) {
+            newRow.assign(rowWords, 0);
+            takeable = node.unknownPrereqs.empty();
+            for (uint32_t prereq : node.prereqs) {
+                addRequired(newRow.data(), prereq);
+                takeable = takeable && nodes[prereq].takeable;
+            }
+        }
+
+        uint64_t* row = rowOf(slot);
+        bool changed = takeable != node.takeable || !equal(newRow.begin(), newRow.end(), row);
+        copy(newRow.begin(), newRow.end(), row);
+        nodes[slot].takeable = takeable;
+        return changed;
+    }
+
+    // Add a prerequisite and everything it requires to a row.
+    void addRequired(uint64_t* row, uint32_t prereq) const {
+        const uint64_t* prereqRow = rowOf(prereq);
+        for (size_t w = 0; w < rowWords; ++w) {
+            row[w] |= prereqRow[w];
+        }
+        row[prereq / 64] |= uint64_t(1) << (prereq % 64);
+    }
+
+    // Work out the courses a postfix rule requires into row, and whether
+    // the rule can be satisfied. A course missing from the catalog can
+    // never be taken. Returns false if the rule is malformed.
+    bool evaluateRule(const vector<string>& rule, uint64_t* row, bool& takeable) {
+        ruleRows.assign(rule.size() * rowWords, 0);
+        ruleTakeable.assign(rule.size(), 0);
+        size_t depth = 0;
+        for (const string& token : rule) {
+            if (token == "AND" || token == "OR") {
+                if (depth < 2) {
+                    return false;
+                }
+                depth--;
+                uint64_t* left = &ruleRows[(depth - 1) * rowWords];
+                const uint64_t* right = &ruleRows[depth * rowWords];
+                bool leftTakeable = ruleTakeable[depth - 1] != 0;
+                bool rightTakeable = ruleTakeable[depth] != 0;
+                if (token == "AND") {
+                    for (size_t w = 0; w < rowWords; ++w) {
+                        left[w] |= right[w];
+                    }
+                    ruleTakeable[depth - 1] = leftTakeable && rightTakeable;
+                }
+                else if (leftTakeable == rightTakeable) {
+                    for (size_t w = 0; w < rowWords; ++w) {
+                        left[w] &= right[w];
+                    }
+                }
+                else if (rightTakeable) {
+                    // Only the right alternative can be taken, so it decides.
+                    copy(right, right + rowWords, left);
+                    ruleTakeable[depth - 1] = 1;
+                }
+                continue;
+            }
+
+            uint64_t* entry = &ruleRows[depth * rowWords];
+            fill(entry, entry + rowWords, 0);
+            uint32_t prereq = findSlot(token);
+            ruleTakeable[depth] = prereq != noSlot && nodes[prereq].takeable;
+            if (prereq != noSlot) {
+                addRequired(entry, prereq);
+            }
+            depth++;
+        }
+        if (depth != 1) {
+            return false;
+        }
+        copy(ruleRows.begin(), ruleRows.begin() + rowWords, row);
+        takeable = ruleTakeable[0] != 0;
+        return true;
+    }
+
+    void computeRowBySearch(uint32_t slot) {
+        uint64_t* row = rowOf(slot);
+        fill(row, row + rowWords, 0);
+        vector<uint32_t> pending = nodes[slot].prereqs;
+        while (!pending.empty()) {
+            uint32_t prereq = pending.back();
+            pending.pop_back();
+            uint64_t bit = uint64_t(1) << (prereq % 64);
+            if ((row[prereq / 64] & bit) == 0) {
+                row[prereq / 64] |= bit;
+                pending.insert(pending.end(), nodes[prereq].prereqs.begin(),
+                               nodes[prereq].prereqs.end());
+            }
+        }
+    }
+};
+
+// -----------------------------
+// NUMA catalog replicas
+// -----------------------------
+
+// Read a sysfs CPU list such as "0-3,8-11" into CPU numbers.
+vector<int> parseCpuList(const string& text) {
+    vector<int> cpus;
+    for (const string& range : split(trim(text), ',')) {
+        size_t dash = range.find('-');
+        int first = atoi(range.c_str());
+        int last = dash == string::npos ? first : atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// The CPUs of each NUMA node, from sysfs. A system that does not report
+// its nodes is treated as one node with no CPUs listed, and threads on it
+// are not pinned.
+vector<vector<int>> readNumaNodes() {
+    vector<vector<int>> nodes;
+    ifstream online("/sys/devices/system/node/online");
+    string text;
+    if (getline(online, text)) {
+        for (int node : parseCpuList(text)) {
+            ifstream cpuList("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+            string cpus;
+            if (getline(cpuList, cpus) && !parseCpuList(cpus).empty()) {
+                nodes.push_back(parseCpuList(cpus));
+            }
+        }
+    }
+    if (nodes.empty()) {
+        nodes.emplace_back();
+    }
+    return nodes;
+}
+
+// Let the calling thread run only on the given CPUs. Does nothing for an
+// empty list or outside Linux.
+void pinThreadToCpus(const vector<int>& cpus) {
+#if defined(__linux__)
+    if (cpus.empty()) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+#else
+    (void)cpus;
+#endif
+}
+
+// Read-only copies of the catalog, one per NUMA node. Each copy, course
+// data included, is made by a thread pinned to its node, so under the
+// kernel's first-touch policy its memory is on that node, and workers
+// pinned to the node read only local memory. Course IDs are the same in
+// every copy.
+class CatalogReplicas {
+public:
+    // Copy the catalog to every node, or, with replicate false, make a
+    // single copy on the first node that every worker shares, which is
+    // how an unreplicated catalog ends up on a multi-socket machine.
+    void build(const CatalogIndex& source, bool replicate) {
+        nodes = readNumaNodes();
+        replicas.clear();
+        replicas.resize(replicate ? nodes.size() : 1);
+
+        vector<thread> builders;
+        for (size_t node = 0; node < replicas.size(); ++node) {
+            builders.emplace_back([this, &source, node]() {
+                pinThreadToCpus(nodes[node]);
+                unique_ptr<Replica> replica = make_unique<Replica>();
+                replica->courseData.reserve(source.size());
+                for (const Course* course : source.courses) {
+                    replica->courseData.push_back(*course);
+                }
+                replica->index = source;
+                for (size_t id = 0; id < source.size(); ++id) {
+                    replica->index.courses[id] = &replica->courseData[id];
+                }
+                replicas[node] = move(replica);
+            });
+        }
+        for (thread& builder : builders) {
+            builder.join();
+        }
+    }
+
+    size_t nodeCount() const {
+        return nodes.size();
+    }
+
+    size_t replicaCount() const {
+        return replicas.size();
+    }
+
+    // The node worker number worker runs on. Workers are spread over the
+    // nodes in turn.
+    size_t nodeOfWorker(size_t worker) const {
+        return worker % nodes.size();
+    }
+
+    // Pin the calling thread to its worker's node and return the catalog
+    // it should read. The pin is never undone, so call it only from a
+    // thread started for the worker.
+    const CatalogIndex& pinWorker(size_t worker) const {
+        size_t node = nodeOfWorker(worker);
+        pinThreadToCpus(nodes[node]);
+        return replicas[replicas.size() == 1 ? 0 : node]->index;
+    }
+
+private:
+    struct Replica {
+        vector<Course> courseData;
+        CatalogIndex index;
+    };
+
+    vector<vector<int>> nodes;
+    vector<unique_ptr<Replica>> replicas;
+};
+
+// -----------------------------
+// Degree audit
+// -----------------------------
+
+// One student's transcript with course numbers already mapped to IDs.
+struct StudentTranscript {
+    string studentId;
+    vector<uint32_t> completed;
+};
+
+// Evaluate eligibility for up to 64 students at once. The completed sets
+// are stored bit-sliced: slices[c] has bit s set if student s completed
+// course c. One pass over the catalog then answers a course for all 64
+// students with a handful of word ANDs. slices must hold one zero word
+// per course on entry and is left that way on return.
+void evaluateEligibilityBatch(const CatalogIndex& index, const StudentTranscript* students,
+                              size_t studentCount, vector<uint64_t>& slices,
+                              vector<vector<uint32_t>>& eligible) {
+    for (size_t s = 0; s < studentCount; ++s) {
+        for (uint32_t id : students[s].completed) {
+            slices[id] |= uint64_t(1) << s;
+        }
+    }
+
+    uint64_t allStudents = studentCount == 64 ? ~uint64_t(0)
+                                              : (uint64_t(1) << studentCount) - 1;
+    eligible.resize(studentCount);
+    for (size_t s = 0; s < studentCount; ++s) {
+        eligible[s].clear();
+    }
+
+    uint32_t count = static_cast<uint32_t>(index.size());
+    for (uint32_t id = 0; id < count; ++id) {
+        uint64_t mask = allStudents & ~slices[id];
+        uint8_t flags = index.prereqFlags[id];
+        if (flags & CatalogIndex::prereqMissing) {
+            mask = 0;
+        }
+        if (flags & CatalogIndex::prereqHasRule) {
+            mask &= runPrerequisiteRule(index, id, [&slices](uint32_t prereq) {
+                return slices[prereq];
+            });
+        }
+        else {
+            for (uint32_t e = index.prereqStart[id]; e < index.prereqStart[id + 1] && mask != 0; ++e) {
+                mask &= slices[index.prereqIds[e]];
+            }
+        }
+        while (mask != 0) {
+            eligible[countTrailingZeros(mask)].push_back(id);
+            mask &= mask - 1;
+        }
+    }
+
+    for (size_t s = 0; s < studentCount; ++s) {
+        for (uint32_t id : students[s].completed) {
+            slices[id] = 0;
+        }
+    }
+}
+
+// Totals reported at the end of an audit.
+struct AuditSummary {
+    size_t students = 0;
+    size_t unknownCourses = 0;
+    size_t eligibleCourses = 0;
+};
+
+// Run the eligibility check for every student in a transcripts file and
+// write one line per student: the student ID followed by the courses they
+// can take next. Each input line is a student ID followed by their
+// completed course numbers, separated by commas.
+//
+// Students are read in rounds. Each round is split into batches of 64
+// students that worker threads evaluate in parallel, and the results are
+// written in input order before the next round is read, so memory use
+// stays flat no matter how large the file is. Given replicas, each worker
+// is pinned to a NUMA node and evaluates against that node's copy.
+bool runDegreeAudit(const CatalogIndex& index, const string& transcriptFile, ostream& out,
+                    AuditSummary& summary, const CatalogReplicas* replicas = nullptr) {
+    ifstream input(transcriptFile);
+    if (!input.is_open()) {
+        cerr << "Error opening file: " << transcriptFile << endl;
+        return false;
+    }
+
+    const size_t batchSize = 64;
+    size_t workerCount = workerThreadCount();
+    size_t roundSize = batchSize * workerCount * 8;
+
+    vector<StudentTranscript> round;
+    vector<string> batchOutput;
+    vector<vector<uint64_t>> workerSlices(workerCount);
+    atomic<size_t> eligibleTotal(0);
+    string line;
+    bool moreInput = true;
+
+    while (moreInput) {
+        // Read the next round of transcripts, mapping course numbers to IDs.
+        round.clear();
+        while (round.size() < roundSize && (moreInput = static_cast<bool>(getline(input, line)))) {
+            vector<string> tokens = split(line, ',');
+            if (tokens.empty() || trim(tokens[0]).empty()) {
+                continue;
+            }
+
+            StudentTranscript student;
+            student.studentId = trim(tokens[0]);
+            for (size_t i = 1; i < tokens.size(); ++i) {
+                uint32_t id;
+                if (findCourseId(index, tokens[i], id)) {
+                    student.completed.push_back(id);
+                }
+                else if (!trim(tokens[i]).empty()) {
+                    summary.unknownCourses++;
+                }
+            }
+            round.push_back(move(student));
+        }
+        if (round.empty()) {
+            break;
+        }
+
+        size_t batchCount = (round.size() + batchSize - 1) / batchSize;
+        batchOutput.assign(batchCount, string());
+        atomic<size_t> nextBatch(0);
+
+        auto auditWorker = [&](size_t worker) {
+            const CatalogIndex& catalog = replicas != nullptr ? replicas->pinWorker(worker) : index;
+            vector<uint64_t>& slices = workerSlices[worker];
+            slices.resize(catalog.size(), 0);
+            vector<vector<uint32_t>> eligible;
+
+            for (size_t b = nextBatch++; b < batchCount; b = nextBatch++) {
+                size_t first = b * batchSize;
+                size_t studentCount = min(batchSize, round.size() - first);
+                evaluateEligibilityBatch(catalog, &round[first], studentCount, slices, eligible);
+
+                string& text = batchOutput[b];
+                size_t found = 0;
+                for (size_t s = 0; s < studentCount; ++s) {
+                    text += round[first + s].studentId;
+                    for (uint32_t id : eligible[s]) {
+                        text += ',';
+                        text += catalog.courses[id]->courseNumber;
+                    }
+                    text += '\n';
+                    found += eligible[s].size();
+                }
+                eligibleTotal += found;
+            }
+        };
+
+        // Workers pinned to a node each get their own thread, so the
+        // caller's thread keeps its CPU affinity.
+        vector<thread> workers;
+        for (size_t w = replicas != nullptr ? 0 : 1; w < min(workerCount, batchCount); ++w) {
+            workers.emplace_back(auditWorker, w);
+        }
+        if (replicas == nullptr) {
+            auditWorker(0);
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+
+        for (const string& text : batchOutput) {
+            out << text;
+        }
+        summary.students += round.size();
+    }
+
+    out.flush();
+    summary.eligibleCourses = eligibleTotal;
+    return true;
+}
+
+// -----------------------------
+// Section meeting times
+// -----------------------------
+
+// One section of a course and when it meets, e.g. CSCI200 section 01 on
+// Monday, Wednesday and Friday from 9:00 to 9:50. Sections are read from
+// their own file with lines such as "CSCI200,01,MWF,09:00,09:50".
+struct Section {
+    string courseNumber;   // canonical form
+    string name;
+    uint8_t days = 0;      // bit 0 is Monday, bit 6 is Sunday
+    uint16_t start = 0;    // minutes after midnight
+    uint16_t end = 0;      // minutes after midnight, not included
+};
+
+// True if two sections meet on a common day at overlapping times.
+bool sectionsOverlap(const Section& a, const Section& b) {
+    return (a.days & b.days) != 0 && a.start < b.end && b.start < a.end;
+}
+
+// Read meeting days such as "MWF" or "TR" (R is Thursday, S Saturday and
+// U Sunday). Returns false if a letter is not a day.
+bool parseMeetingDays(const string& text, uint8_t& days) {
+    static const string letters = "MTWRFSU";
+    days = 0;
+    for (char c : text) {
+        if (isspace(static_cast<unsigned char>(c))) {
+            continue;
+        }
+        size_t day = letters.find(static_cast<char>(toupper(static_cast<unsigned char>(c))));
+        if (day == string::npos) {
+            return false;
+        }
+        days |= static_cast<uint8_t>(1u << day);
+    }
+    return days != 0;
+}
+
+// Read a 24-hour time such as "9:00" or "13:30" as minutes after midnight.
+bool parseMeetingTime(const string& text, uint16_t& minutes) {
+    string time = trim(text);
+    size_t colon = time.find(':');
+    uint32_t hours;
+    uint32_t mins;
+    if (colon == string::npos || !parseQueryNumber(time.substr(0, colon), hours)
+        || time.size() - colon != 3 || !parseQueryNumber(time.substr(colon + 1), mins)
+        || hours > 23 || mins > 59) {
+        return false;
+    }
+    minutes = static_cast<uint16_t>(hours * 60 + mins);
+    return true;
+}
+
+// Format minutes after midnight as a 24-hour time.
+string formatMeetingTime(uint16_t minutes) {
+    string text = to_string(minutes / 60) + ":";
+    if (minutes % 60 < 10) {
+        text += "0";
+    }
+    return text + to_string(minutes % 60);
+}
+
+// Format a section's meeting pattern, e.g. "CSCI200-01 MWF 9:00-9:50".
+string formatSection(const Section& section) {
+    static const char letters[] = "MTWRFSU";
+    string days;
+    for (int day = 0; day < 7; ++day) {
+        if (section.days & (1u << day)) {
+            days += letters[day];
+        }
+    }
+    return section.courseNumber + "-" + section.name + " " + days + " "
+         + formatMeetingTime(section.start) + "-" + formatMeetingTime(section.end);
+}
+
+// Load section meeting times from a CSV file. A first line whose first
+// field is a column name such as "Course" is skipped. Warnings are
+// printed and the line is skipped. Returns false if the file could not
+// be opened.
+bool loadSectionsFromFile(const string& fileName, vector<Section>& sections) {
+    ifstream input(fileName);
+    if (!input.is_open()) {
+        cout << "Error opening file: " << fileName << endl;
+        return false;
+    }
+
+    sections.clear();
+    string line;
+    int lineNumber = 0;
+    while (getline(input, line)) {
+        lineNumber++;
+        if (trim(line).empty()) {
+            continue;
+        }
+        vector<string> tokens = split(line, ',');
+        if (lineNumber == 1 && catalogColumnForName(tokens[0]) == CatalogColumn::Number) {
+            continue;
+        }
+
+        Section section;
+        CourseKey key = canonicalCourseKey(tokens[0]);
+        if (tokens.size() < 5 || !key.valid || key.empty()) {
+            cout << "Section format error in " << fileName << " on line " << lineNumber
+                 << ": expected course, section, days, start time and end time." << endl;
+            continue;
+        }
+        section.courseNumber.assign(key.text, key.length);
+        section.name = trim(tokens[1]);
+        if (!parseMeetingDays(tokens[2], section.days) || !parseMeetingTime(tokens[3], section.start)
+            || !parseMeetingTime(tokens[4], section.end) || section.end <= section.start) {
+            cout << "Section format error in " << fileName << " on line " << lineNumber
+                 << ": the days or times are not valid." << endl;
+            continue;
+        }
+        sections.push_back(move(section));
+    }
+    return true;
+}
+
+// The loaded sections matched to catalog course IDs, with an interval
+// tree per day of the week for overlap searches. Each day's tree is
+// stored implicitly: the day's section IDs are sorted by start time, the
+// middle of any range is the root of that range's subtree, and
+// maxEnd[i] holds the latest end time in the subtree rooted at i. A
+// search skips every subtree that ends before the interval starts and
+// every right subtree that starts after it ends.
+class SectionIndex {
+public:
+    vector<Section> sections;    // sorted by course ID, then section name
+    vector<uint32_t> courseIds;  // section ID -> catalog course ID
+
+    // Match the sections to the catalog and build the day trees. Sections
+    // of courses that are not in the catalog are left out and counted in
+    // unknownCourses.
+    void build(const vector<Section>& loaded, const CatalogIndex& index) {
+        sourceHash = index.sourceHash;
+        unknownCourses = 0;
+        vector<pair<uint32_t, const Section*>> matched;
+        for (const Section& section : loaded) {
+            uint32_t id;
+            if (findCourseId(index, section.courseNumber, id)) {
+                matched.push_back({ id, &section });
+            }
+            else {
+                unknownCourses++;
+            }
+        }
+        sort(matched.begin(), matched.end(), [](const pair<uint32_t, const Section*>& a,
+                                                const pair<uint32_t, const Section*>& b) {
+            return a.first != b.first ? a.first < b.first : a.second->name < b.second->name;
+        });
+
+        sections.clear();
+        courseIds.clear();
+        for (const auto& entry : matched) {
+            sections.push_back(*entry.second);
+            sections.back().courseNumber = index.courses[entry.first]->courseNumber;
+            courseIds.push_back(entry.first);
+        }
+
+        for (int day = 0; day < 7; ++day) {
+            vector<uint32_t>& order = dayOrder[day];
+            order.clear();
+            for (uint32_t s = 0; s < sections.size(); ++s) {
+                if (sections[s].days & (1u << day)) {
+                    order.push_back(s);
+                }
+            }
+            sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+                return sections[a].start < sections[b].start;
+            });
+            dayMaxEnd[day].assign(order.size(), 0);
+            buildMaxEnd(day, 0, order.size());
+        }
+    }
+
+    // True if the index was built from the catalog as it is now.
+    bool isCurrent(const CatalogIndex& index) const {
+        return sourceHash == index.sourceHash;
+    }
+
+    size_t unknownCourseCount() const {
+        return unknownCourses;
+    }
+
+    // The section IDs of a course are first up to last - 1.
+    void sectionsOf(uint32_t courseId, uint32_t& first, uint32_t& last) const {
+        first = static_cast<uint32_t>(lower_bound(courseIds.begin(), courseIds.end(), courseId)
+                                      - courseIds.begin());
+        last = static_cast<uint32_t>(upper_bound(courseIds.begin(), courseIds.end(), courseId)
+                                     - courseIds.begin());
+    }
+
+    // Find a section by course ID and section name.
+    bool findSection(uint32_t courseId, const string& name, uint32_t& sectionId) const {
+        uint32_t first;
+        uint32_t last;
+        sectionsOf(courseId, first, last);
+        for (uint32_t s = first; s < last; ++s) {
+            if (sections[s].name == name) {
+                sectionId = s;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Add the IDs of every section that overlaps the given section to
+    // overlapping, sorted and without repeats.
+    void findOverlapping(const Section& section, vector<uint32_t>& overlapping) const {
+        overlapping.clear();
+        for (int day = 0; day < 7; ++day) {
+            if (section.days & (1u << day)) {
+                searchDay(day, 0, dayOrder[day].size(), section.start, section.end, overlapping);
+            }
+        }
+        sort(overlapping.begin(), overlapping.end());
+        overlapping.erase(unique(overlapping.begin(), overlapping.end()), overlapping.end());
+    }
+
+private:
+    vector<uint32_t> dayOrder[7];   // section IDs meeting on the day, by start time
+    vector<uint16_t> dayMaxEnd[7];
+    uint64_t sourceHash = 0;
+    size_t unknownCourses = 0;
+
+    uint16_t buildMaxEnd(int day, size_t begin, size_t end) {
+        if (begin >= end) {
+            return 0;
+        }
+        size_t middle = begin + (end - begin) / 2;
+        uint16_t maxEnd = sections[dayOrder[day][middle]].end;
+        maxEnd = max(maxEnd, buildMaxEnd(day, begin, middle));
+        maxEnd = max(maxEnd, buildMaxEnd(day, middle + 1, end));
+        dayMaxEnd[day][middle] = maxEnd;
+        return maxEnd;
+    }
+
+    void searchDay(int day, size_t begin, size_t end, uint16_t start, uint16_t finish,
+                   vector<uint32_t>& overlapping) const {
+        while (begin < end) {
+            size_t middle = begin + (end - begin) / 2;
+            if (dayMaxEnd[day][middle] <= start) {
+                return;
+            }
+            searchDay(day, begin, middle, start, finish, overlapping);
+
+            const Section& section = sections[dayOrder[day][middle]];
+            if (section.start >= finish) {
+                return;
+            }
+            if (section.end > start) {
+                overlapping.push_back(dayOrder[day][middle]);
+            }
+            begin = middle + 1;
+        }
+    }
+};
+
+// Find every way to pick one section of each course so that no two picked
+// sections overlap. The sections are checked against each other once up
+// front, giving a bit set per section of the sections it fits with. The
+// search then always branches on the course with the fewest sections
+// still possible, and backs out as soon as any course has none left.
+// Up to maxKept schedules are kept (as section IDs in the order of
+// courseIds); the return value is how many there are, counting stops at
+// maxCounted.
+size_t findConflictFreeSchedules(const SectionIndex& sectionIndex, const vector<uint32_t>& courseIds,
+                                 size_t maxKept, vector<vector<uint32_t>>& schedules,
+                                 size_t maxCounted = 1000000) {
+    schedules.clear();
+    size_t courseCount = courseIds.size();
+    if (courseCount == 0) {
+        return 0;
+    }
+
+    // The candidate sections, numbered 0..n-1, and the course each is for.
+    vector<uint32_t> candidates;
+    vector<uint32_t> candidateCourse;
+    for (size_t c = 0; c < courseCount; ++c) {
+        uint32_t first;
+        uint32_t last;
+        sectionIndex.sectionsOf(courseIds[c], first, last);
+        for (uint32_t s = first; s < last; ++s) {
+            candidates.push_back(s);
+            candidateCourse.push_back(static_cast<uint32_t>(c));
+        }
+    }
+    size_t n = candidates.size();
+    size_t words = (n + 63) / 64;
+
+    // fits[i] has bit j set if candidates i and j are for different
+    // courses and do not overlap.
+    vector<uint64_t> fits(n * words, 0);
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = i + 1; j < n; ++j) {
+            if (candidateCourse[i] != candidateCourse[j]
+                && !sectionsOverlap(sectionIndex.sections[candidates[i]],
+                                    sectionIndex.sections[candidates[j]])) {
+                fits[i * words + j / 64] |= uint64_t(1) << (j % 64);
+                fits[j * words + i / 64] |= uint64_t(1) << (i % 64);
+            }
+        }
+    }
+
+    // courseMask[c] has the bits of course c's candidates.
+    vector<uint64_t> courseMask(courseCount * words, 0);
+    for (size_t i = 0; i < n; ++i) {
+        courseMask[candidateCourse[i] * words + i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    auto countIn = [&](const uint64_t* allowed, size_t course) {
+        size_t count = 0;
+        for (size_t w = 0; w < words; ++w) {
+            count += countSetBits(allowed[w] & courseMask[course * words + w]);
+        }
+        return count;
+    };
+
+    // allowed holds one bit set per search depth.
+    vector<uint64_t> allowed((courseCount + 1) * words, ~uint64_t(0));
+    vector<bool> placed(courseCount, false);
+    vector<uint32_t> picked(courseCount);
+    size_t found = 0;
+
+    function<void(size_t)> search = [&](size_t depth) {
+        if (found >= maxCounted) {
+            return;
+        }
+        if (depth == courseCount) {
+            if (schedules.size() < maxKept) {
+                schedules.push_back(picked);
+            }
+            found++;
+            return;
+        }
+
+        const uint64_t* current = &allowed[depth * words];
+        size_t course = courseCount;
+        size_t fewest = SIZE_MAX;
+        for (size_t c = 0; c < courseCount; ++c) {
+            if (placed[c]) {
+                continue;
+            }
+            size_t count = countIn(current, c);
+            if (count == 0) {
+                return;
+            }
+            if (count < fewest) {
+                fewest = count;
+                course = c;
+            }
+        }
+
+        placed[course] = true;
+        uint64_t* next = &allowed[(depth + 1) * words];
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t bits = current[w] & courseMask[course * words + w];
+            while (bits != 0) {
+                size_t i = w * 64 + countTrailingZeros(bits);
+                bits &= bits - 1;
+                for (size_t v = 0; v < words; ++v) {
+                    next[v] = current[v] & fits[i * words + v];
+                }
+                picked[course] = candidates[i];
+                search(depth + 1);
+            }
+        }
+        placed[course] = false;
+    };
+    search(0);
+    return found;
+}
+
+// -----------------------------
+// Printing functions
+// -----------------------------
+
+// A tree is reported as unbalanced when its height is more than twice the
+// height of a balanced tree with the same number of nodes.
+bool isTreeUnbalanced(const TreeStats& stats) {
+    return stats.nodeCount > 0 && stats.height > 2 * stats.idealHeight();
+}
+
+// Print the shape of the course tree and what an average search costs.
+void printTreeStatistics(const CourseBST& tree) {
+    TreeStats stats = tree.computeStats();
+    if (stats.nodeCount == 0) {
+        cout << "No courses loaded." << endl;
+        return;
+    }
+
+    cout << endl;
+    cout << "Nodes:                " << stats.nodeCount
+         << " (including cross-listed numbers)" << endl;
+    cout << "Tree height:          " << stats.height
+         << " (balanced: " << stats.idealHeight() << ")" << endl;
+    cout << "Average search depth: " << stats.averageDepth() << endl;
+    cout << "Maximum search depth: " << stats.height << endl;
+    cout << "Node memory:          " << pageBackingName(tree.getPageBacking()) << endl;
+
+    // Each visited node costs up to two string comparisons in searchHelper.
+    cout << "Average search cost:  about " << stats.averageDepth()
+         << " nodes visited, up to " << 2 * stats.averageDepth()
+         << " string comparisons" << endl;
+
+    // Group depths into at most 32 rows so a degenerate tree still prints
+    // a readable histogram.
+    size_t rowWidth = (stats.height + 31) / 32;
+    cout << "Depth histogram:" << endl;
+    for (size_t first = 1; first <= stats.height; first += rowWidth) {
+        size_t last = min(stats.height, first + rowWidth - 1);
+        size_t count = 0;
+        for (size_t depth = first; depth <= last; ++depth) {
+            count += stats.depthHistogram[depth];
+        }
+
+        string label = to_string(first);
+        if (last != first) {
+            label += "-" + to_string(last);
+        }
+        cout << "  " << label << string(label.size() < 12 ? 12 - label.size() : 1, ' ')
+             << count << endl;
+    }
+
+    if (isTreeUnbalanced(stats)) {
+        cout << "Warning: the tree is unbalanced; lookups are slower than they should be." << endl;
+    }
+}
+
+// Print a one-line summary of the tree shape after a load, with a warning
+// if the input ordering made the tree unbalanced.
+void printTreeBalanceSummary(const CourseBST& tree) {
+    TreeStats stats = tree.computeStats();
+    cout << "Tree: " << stats.nodeCount << " nodes, height " << stats.height
+         << " (balanced: " << stats.idealHeight() << "), average search depth "
+         << stats.averageDepth() << endl;
+    if (isTreeUnbalanced(stats)) {
+        cout << "Warning: the tree is unbalanced; lookups are slower than they should be." << endl;
+    }
+}
+
+// Print detailed information for one course, including its prerequisites.
+void printCourseInformation(CourseBST& tree, const string& targetNumber) {
+    CourseKey searchKey = canonicalCourseKey(targetNumber);
+    Course* found = searchKey.valid ? tree.search(searchKey.view()) : nullptr;
+
+    if (found == nullptr) {
+        cout << "Course " << toUpper(trim(targetNumber)) << " not found." << endl;
+        return;
+    }
+
+    cout << endl;
+    cout << found->courseNumber << ", " << found->courseTitle << endl;
+
+    if (found->creditHours != 0) {
+        cout << "Credit hours: " << static_cast<int>(found->creditHours) << endl;
+    }
+    if (found->termsOffered != 0) {
+        cout << "Terms offered: " << formatTermList(found->termsOffered) << endl;
+    }
+    if (!found->campus.empty()) {
+        cout << "Campus: " << found->campus << endl;
+    }
+
+    if (!found->aliases.empty()) {
+        cout << "Cross-listed as:";
+        for (const string& alias : found->aliases) {
+            cout << " " << alias;
+        }
+        cout << endl;
+    }
+
+    if (found->prerequisites.empty()) {
+        cout << "Prerequisites: None" << endl;
+    }
+    else if (!found->prerequisiteRule.empty()) {
+        // Show the rule with each course number followed by its title.
+        vector<string> postfix;
+        string error;
+        parsePrerequisiteRule(found->prerequisiteRule, postfix, error);
+        cout << "Prerequisites: "
+             << formatPrerequisiteRule(postfix, [&tree](const string& number) {
+                    Course* prereqCourse = tree.search(number);
+                    if (prereqCourse == nullptr) {
+                        return number + " (course not found in data)";
+                    }
+                    return prereqCourse->courseNumber + " (" + prereqCourse->courseTitle + ")";
+                })
+             << endl;
+    }
+    else {
+        cout << "Prerequisites:" << endl;
+
+        // For each prerequisite, try to print its number and title.
+        for (const string& prereqId : found->prerequisites) {
+            Course* prereqCourse = tree.search(prereqId);
+
+            if (prereqCourse != nullptr) {
+                cout << "  " << prereqCourse->courseNumber
+                     << ", " << prereqCourse->courseTitle << endl;
+            }
+            else {
+                // If the prerequisite is not in the tree, at least show its ID.
+                cout << "  " << prereqId << " (course not found in data)" << endl;
+            }
+        }
+    }
+}
+
+// Print all courses in a precomputed listing order.
+void printCourseListing(const CatalogIndex& index, const vector<uint32_t>& order) {
+    for (uint32_t id : order) {
+        cout << index.courses[id]->courseNumber << ", "
+             << index.courses[id]->courseTitle << endl;
+    }
+}
+
+// Print the courses that gate the most downstream material.
+void printBottleneckCourses(const CatalogIndex& index, size_t k) {
+    vector<RankedCourse> ranked = topRankedCourses(computePrerequisiteRank(index), k);
+
+    cout << endl;
+    cout << "Rank  Course, Title  (score, direct dependents, all dependents)" << endl;
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        uint32_t id = ranked[i].id;
+        const Course* course = index.courses[id];
+        cout << i + 1 << ".  " << course->courseNumber << ", " << course->courseTitle
+             << "  (" << ranked[i].score
+             << ", " << index.dependentStart[id + 1] - index.dependentStart[id]
+             << ", " << countAllDependents(index, id) << ")" << endl;
+    }
+}
+
+// Print the longest prerequisite chain ending at a course, or the longest
+// chain in the whole catalog if no course number is given.
+void printPrerequisiteChain(const CatalogIndex& index, const string& targetNumber) {
+    uint32_t id = index.longestChainEnd;
+    if (!targetNumber.empty() && !findCourseId(index, targetNumber, id)) {
+        cout << "Course " << toUpper(targetNumber) << " not found." << endl;
+        return;
+    }
+    if (id == CatalogIndex::noCourse) {
+        cout << "No prerequisite chains found; every course is in or depends on a prerequisite cycle." << endl;
+        return;
+    }
+
+    const Course* course = index.courses[id];
+    cout << endl;
+    if (index.chainLength[id] == 0) {
+        if (index.prereqFlags[id] & CatalogIndex::prereqHasRule) {
+            cout << "No alternative in the prerequisite rule for " << course->courseNumber
+                 << " can be completed, so it can never be taken." << endl;
+        }
+        else {
+            cout << course->courseNumber << " depends on a prerequisite cycle, "
+                 << "so it can never be taken." << endl;
+        }
+        return;
+    }
+
+    if (targetNumber.empty()) {
+        cout << "Longest prerequisite chain in the catalog ends at "
+             << course->courseNumber << "." << endl;
+    }
+    cout << "Minimum number of terms to complete " << course->courseNumber << ": "
+         << index.chainLength[id] << endl;
+
+    // Walk back along the chain, then print it from the first course.
+    vector<uint32_t> chain;
+    for (uint32_t step = id; step != CatalogIndex::noCourse; step = index.chainPrevious[step]) {
+        chain.push_back(step);
+    }
+    for (size_t i = chain.size(); i-- > 0;) {
+        cout << "  Term " << chain.size() - i << ": " << index.courses[chain[i]]->courseNumber
+             << ", " << index.courses[chain[i]]->courseTitle << endl;
+    }
+}
+
+// Print the courses on each curriculum level, in course number order.
+void printCurriculumMap(const CatalogIndex& index) {
+    CurriculumLevels levels;
+    computeCurriculumLevels(index, levels);
+
+    cout << endl;
+    for (size_t level = 0; level < levels.levelCount(); ++level) {
+        vector<uint32_t> ids(levels.courseIds.begin() + levels.levelStart[level],
+                             levels.courseIds.begin() + levels.levelStart[level + 1]);
+        sort(ids.begin(), ids.end());
+
+        cout << "Level " << level;
+        if (level == 0) {
+            cout << " (no prerequisites)";
+        }
+        cout << ": " << ids.size() << " courses" << endl;
+        for (uint32_t id : ids) {
+            cout << "  " << index.courses[id]->courseNumber << ", "
+                 << index.courses[id]->courseTitle << endl;
+        }
+    }
+
+    if (levels.courseIds.size() < index.size()) {
+        cout << "Not placed (in or behind a prerequisite cycle): "
+             << index.size() - levels.courseIds.size() << " courses" << endl;
+        for (size_t id = 0; id < index.size(); ++id) {
+            if (levels.level[id] == CatalogIndex::noCourse) {
+                cout << "  " << index.courses[id]->courseNumber << ", "
+                     << index.courses[id]->courseTitle << endl;
+            }
+        }
+    }
+}
+
+// Print every course a student can take next, given a comma-separated
+// list of the courses they have completed.
+void printEligibleCourses(const CatalogIndex& index, const string& completedList) {
+    CourseBitmap completed = makeCourseBitmap(index);
+    for (const string& number : split(completedList, ',')) {
+        if (trim(number).empty()) {
+            continue;
+        }
+        uint32_t id;
+        if (findCourseId(index, number, id)) {
+            setCourseBit(completed, id);
+        }
+        else {
+            cout << "Course " << toUpper(trim(number)) << " not found; it was ignored." << endl;
+        }
+    }
+
+    vector<uint32_t> eligible;
+    findEligibleCourses(index, completed, eligible);
+    cout << endl;
+    cout << "Courses you can take next:" << endl;
+    for (uint32_t id : eligible) {
+        cout << "  " << index.courses[id]->courseNumber << ", "
+             << index.courses[id]->courseTitle << endl;
+    }
+    if (eligible.empty()) {
+        cout << "  None" << endl;
+    }
+}
+
+// Print the sections that meet at the same time as any section in a
+// comma-separated schedule such as "CSCI200-01, MATH201-02", including
+// conflicts between the schedule's own sections.
+void printScheduleConflicts(const CatalogIndex& index, const SectionIndex& sectionIndex,
+                            const string& scheduleList) {
+    vector<uint32_t> schedule;
+    for (const string& item : split(scheduleList, ',')) {
+        string text = trim(item);
+        if (text.empty()) {
+            continue;
+        }
+        size_t dash = text.rfind('-');
+        uint32_t courseId;
+        uint32_t sectionId;
+        if (dash == string::npos || !findCourseId(index, text.substr(0, dash), courseId)
+            || !sectionIndex.findSection(courseId, trim(text.substr(dash + 1)), sectionId)) {
+            cout << "Section " << toUpper(text) << " not found; it was ignored." << endl;
+            continue;
+        }
+        schedule.push_back(sectionId);
+    }
+
+    cout << endl;
+    vector<uint32_t> overlapping;
+    size_t conflicts = 0;
+    for (uint32_t sectionId : schedule) {
+        const Section& section = sectionIndex.sections[sectionId];
+        sectionIndex.findOverlapping(section, overlapping);
+
+        bool printedHeading = false;
+        for (uint32_t other : overlapping) {
+            if (other == sectionId) {
+                continue;
+            }
+            if (!printedHeading) {
+                cout << formatSection(section) << " conflicts with:" << endl;
+                printedHeading = true;
+            }
+            bool inSchedule = find(schedule.begin(), schedule.end(), other) != schedule.end();
+            cout << "  " << formatSection(sectionIndex.sections[other])
+                 << (inSchedule ? " (in this schedule)" : "") << endl;
+            conflicts++;
+        }
+    }
+    if (conflicts == 0) {
+        cout << "No sections conflict with this schedule." << endl;
+    }
+}
+
+// Print every conflict-free way to take the courses in a comma-separated
+// list, one section per course.
+void printConflictFreeSchedules(const CatalogIndex& index, const SectionIndex& sectionIndex,
+                                const string& courseList) {
+    vector<uint32_t> courseIds;
+    for (const string& number : split(courseList, ',')) {
+        if (trim(number).empty()) {
+            continue;
+        }
+        uint32_t id;
+        uint32_t first;
+        uint32_t last;
+        if (!findCourseId(index, number, id)) {
+            cout << "Course " << toUpper(trim(number)) << " not found; it was ignored." << endl;
+            continue;
+        }
+        sectionIndex.sectionsOf(id, first, last);
+        if (first == last) {
+            cout << "Course " << index.courses[id]->courseNumber << " has no sections." << endl;
+            return;
+        }
+        if (find(courseIds.begin(), courseIds.end(), id) == courseIds.end()) {
+            courseIds.push_back(id);
+        }
+    }
+    if (courseIds.empty()) {
+        return;
+    }
+
+    const size_t shown = 20;
+    vector<vector<uint32_t>> schedules;
+    size_t found = findConflictFreeSchedules(sectionIndex, courseIds, shown, schedules);
+
+    cout << endl;
+    for (size_t s = 0; s < schedules.size(); ++s) {
+        cout << "Schedule " << s + 1 << ":" << endl;
+        for (uint32_t sectionId : schedules[s]) {
+            cout << "  " << formatSection(sectionIndex.sections[sectionId]) << endl;
+        }
+    }
+    if (found == 0) {
+        cout << "These courses cannot all be taken without a time conflict." << endl;
+    }
+    else if (found > schedules.size()) {
+        cout << "Showing " << schedules.size() << " of " << found << " conflict-free schedules."
+             << endl;
+    }
+}
+
+// Ask the planner what would happen if a course were retired or its
+// prerequisites changed. newPrereqs is a comma-separated list of course
+// numbers, or REMOVE to retire the course.
+void printWhatIfImpact(const CatalogIndex& index, const string& courseNumber,
+                       const string& newPrereqs) {
+    WhatIfChange change;
+    if (!findCourseId(index, courseNumber, change.courseId)) {
+        cout << "Course " << toUpper(trim(courseNumber)) << " not found." << endl;
+        return;
+    }
+
+    change.removeCourse = toUpper(trim(newPrereqs)) == "REMOVE";
+    if (!change.removeCourse) {
+        for (const string& number : split(newPrereqs, ',')) {
+            uint32_t prereqId;
+            if (trim(number).empty()) {
+                continue;
+            }
+            if (findCourseId(index, number, prereqId)) {
+                change.newPrereqs.push_back(prereqId);
+            }
+            else {
+                cout << "Course " << toUpper(trim(number)) << " is not in the catalog." << endl;
+                change.newPrereqMissing = true;
+            }
+        }
+    }
+
+    auto start = chrono::steady_clock::now();
+    WhatIfImpact impact = analyzeWhatIf(index, change);
+    double seconds = secondsSince(start);
+
+    auto describe = [&index](uint32_t id) {
+        return index.courses[id]->courseNumber + ", " + index.courses[id]->courseTitle;
+    };
+
+    cout << endl;
+    if (impact.createsCycle) {
+        cout << "That change would create a prerequisite cycle: one of the new "
+             << "prerequisites already requires " << index.courses[change.courseId]->courseNumber
+             << "." << endl;
+        return;
+    }
+
+    cout << "Courses that could no longer be taken: " << impact.blocked.size() << endl;
+    for (uint32_t id : impact.blocked) {
+        cout << "  " << describe(id) << endl;
+    }
+    if (change.removeCourse) {
+        cout << "Dependent courses still available through other prerequisites: "
+             << impact.stillAvailable.size() << endl;
+        for (uint32_t id : impact.stillAvailable) {
+            cout << "  " << describe(id) << endl;
+        }
+    }
+    cout << "Courses whose minimum number of terms changes: " << impact.chainChanges.size() << endl;
+    for (const ChainChange& chainChange : impact.chainChanges) {
+        cout << "  " << describe(chainChange.id) << ": " << chainChange.oldTerms
+             << " -> " << chainChange.newTerms << " terms" << endl;
+    }
+    cout << "(" << impact.coursesVisited << " courses re-evaluated in "
+         << seconds * 1000.0 << " ms)" << endl;
+}
+
+// Print every course a course requires, directly or indirectly.
+void printAllRequiredCourses(CourseBST& tree, const PrerequisiteClosure& closure,
+                             const string& targetNumber) {
+    CourseKey key = canonicalCourseKey(targetNumber);
+    Course* found = key.valid ? tree.search(key.view()) : nullptr;
+    if (found == nullptr) {
+        cout << "Course " << toUpper(trim(targetNumber)) << " not found." << endl;
+        return;
+    }
+
+    vector<string> required = closure.allPrerequisites(found->courseNumber);
+    cout << endl;
+    cout << "All courses required before " << found->courseNumber << ": "
+         << required.size() << endl;
+    for (const string& number : required) {
+        Course* course = tree.search(number);
+        cout << "  " << number << ", " << (course != nullptr ? course->courseTitle : "") << endl;
+    }
+}
+
+// Print the catalog totals by department, in department name order, and
+// by level.
+void printCatalogTotals(const CatalogIndex& index) {
+    CatalogTotals totals;
+    computeCatalogTotals(index, totals);
+
+    vector<uint32_t> departments(index.departmentNames.size());
+    for (uint32_t d = 0; d < departments.size(); ++d) {
+        departments[d] = d;
+    }
+    sort(departments.begin(), departments.end(), [&index](uint32_t a, uint32_t b) {
+        return index.departmentNames[a] < index.departmentNames[b];
+    });
+
+    cout << endl;
+    cout << "Department: courses, credit hours, courses with no prerequisites" << endl;
+    for (uint32_t d : departments) {
+        cout << "  " << (index.departmentNames[d].empty() ? "(none)" : index.departmentNames[d])
+             << ": " << totals.courses[d] << ", " << totals.creditHours[d] << ", "
+             << totals.noPrerequisites[d] << endl;
+    }
+
+    cout << "Courses per level:" << endl;
+    for (size_t level = 0; level < CatalogTotals::levelCount; ++level) {
+        if (totals.coursesPerLevel[level] != 0) {
+            cout << "  " << level * 100 << (level + 1 == CatalogTotals::levelCount ? "+" : "")
+                 << ": " << totals.coursesPerLevel[level] << endl;
+        }
+    }
+}
+
+// Run a query against the loaded catalog and print the matching courses.
+void printQueryResults(const CatalogIndex& index, const string& queryText) {
+    string error;
+    QueryPredicate predicate = prepareQuery(queryText, index, error);
+    if (!predicate) {
+        cout << "Query error: " << error << endl;
+        return;
+    }
+
+    vector<size_t> matches = runQuery(predicate, index);
+    cout << endl;
+    for (size_t id : matches) {
+        cout << index.courses[id]->courseNumber << ", "
+             << index.courses[id]->courseTitle << endl;
+    }
+    cout << matches.size() << " of " << index.size() << " courses matched." << endl;
+}
+
+// -----------------------------
+// Benchmarks
+// -----------------------------
+
+// Build a synthetic catalog of the given size, sorted by course number.
+// Departments are three-letter codes with course numbers 100-999, and each
+// course draws up to three prerequisites from recent lower-numbered
+// courses so the prerequisite graph has no cycles.
+vector<Course> makeSyntheticCatalog(size_t count, uint64_t seed) {
+    mt19937_64 random(seed);
+    vector<Course> courses(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        size_t departmentIndex = i / 900;
+        string department = "AAA";
+        department[0] = static_cast<char>('A' + departmentIndex / 676 % 26);
+        department[1] = static_cast<char>('A' + departmentIndex / 26 % 26);
+        department[2] = static_cast<char>('A' + departmentIndex % 26);
+
+        courses[i].courseNumber = department + to_string(100 + i % 900);
+        courses[i].courseTitle = "Synthetic Course " + to_string(i);
+        courses[i].creditHours = static_cast<uint8_t>(1 + i % 4);
+        courses[i].termsOffered = static_cast<uint8_t>(1 + i * 7 % 15);
+        courses[i].campus = i % 3 == 0 ? "North" : i % 3 == 1 ? "South" : "Online";
+
+        size_t prereqCount = i == 0 ? 0 : random() % 4;
+        for (size_t p = 0; p < prereqCount; ++p) {
+            size_t window = min<size_t>(i, 2000);
+            size_t prereq = i - 1 - random() % window;
+            courses[i].prerequisites.push_back(courses[prereq].courseNumber);
+        }
+    }
+    return courses;
+}
+
+// Print throughput for work that processed itemCount items.
+void printRate(const string& label, size_t itemCount, double seconds, const string& unit) {
+    cout << "  " << label << ": " << itemCount << " " << unit << " in "
+         << seconds * 1000.0 << " ms (" << (seconds > 0 ? itemCount / seconds : 0.0)
+         << " " << unit << "/second)" << endl;
+}
+
+// Counts the data TLB misses of the calling thread with a hardware
+// performance counter. The counter is unavailable outside Linux and where
+// perf events are not permitted, such as in most containers.
+class TlbMissCounter {
+public:
+    TlbMissCounter() {
+#if defined(__linux__)
+        perf_event_attr attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_TYPE_HW_CACHE;
+        attributes.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+#endif
+    }
+
+    ~TlbMissCounter() {
+#if defined(__linux__)
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    TlbMissCounter(const TlbMissCounter&) = delete;
+    TlbMissCounter& operator=(const TlbMissCounter&) = delete;
+
+    bool available() const {
+        return fd >= 0;
+    }
+
+    void start() {
+#if defined(__linux__)
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // Stop counting and return the misses since start().
+    uint64_t stop() {
+        uint64_t misses = 0;
+#if defined(__linux__)
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &misses, sizeof(misses)) != sizeof(misses)) {
+                misses = 0;
+            }
+        }
+#endif
+        return misses;
+    }
+
+private:
+    int fd = -1;
+};
+
+// Kilobytes of this process's memory backed by transparent huge pages, or
+// 0 where that is not reported.
+size_t anonHugePagesKb() {
+    ifstream rollup("/proc/self/smaps_rollup");
+    string line;
+    while (getline(rollup, line)) {
+        if (line.compare(0, 14, "AnonHugePages:") == 0) {
+            return static_cast<size_t>(strtoull(line.c_str() + 14, nullptr, 10));
+        }
+    }
+    return 0;
+}
+
+// Compare single-course lookups: the perfect hash, binary search of the
+// index, the tree, and a general hash map. One lookup in eight is for a
+// number that is not in the catalog.
+void benchmarkLookups(CourseBST& tree, const CatalogIndex& index) {
+    cout << "Course lookup:" << endl;
+
+    CatalogIndex rebuilt;
+    rebuilt.courses = index.courses;
+    rebuilt.aliasIds = index.aliasIds;
+    auto start = chrono::steady_clock::now();
+    buildNumberHash(rebuilt);
+    printRate("perfect hash build", rebuilt.numberHashEntry.size(), secondsSince(start), "keys");
+    cout << "    " << index.numberHash.bitsPerKey() << " bits per key, plus "
+         << 8 * sizeof(uint32_t) << " for the slot-to-course array" << endl;
+
+    mt19937_64 random(71);
+    const size_t lookups = 1000000;
+    vector<CourseKey> keys(lookups);
+    for (CourseKey& key : keys) {
+        string number = index.courses[random() % index.size()]->courseNumber;
+        if (random() % 8 == 0) {
+            number += "X";
+        }
+        key = canonicalCourseKey(number);
+    }
+
+    unordered_map<string_view, uint32_t> hashMap;
+    hashMap.reserve(index.size());
+    for (size_t id = 0; id < index.size(); ++id) {
+        hashMap.emplace(index.courses[id]->courseNumber, static_cast<uint32_t>(id));
+    }
+
+    size_t found = 0;
+    uint32_t id;
+    start = chrono::steady_clock::now();
+    for (const CourseKey& key : keys) {
+        found += findCourseId(index, key, id);
+    }
+    printRate("perfect hash", lookups, secondsSince(start), "lookups");
+
+    start = chrono::steady_clock::now();
+    for (const CourseKey& key : keys) {
+        found += searchCourseId(index, key, id);
+    }
+    printRate("binary search", lookups, secondsSince(start), "lookups");
+
+    start = chrono::steady_clock::now();
+    for (const CourseKey& key : keys) {
+        found += tree.search(key.view()) != nullptr;
+    }
+    printRate("CourseBST::search", lookups, secondsSince(start), "lookups");
+
+    start = chrono::steady_clock::now();
+    for (const CourseKey& key : keys) {
+        found += hashMap.count(key.view());
+    }
+    printRate("unordered_map", lookups, secondsSince(start), "lookups");
+    cout << "    " << found / 4 << " of " << lookups << " found by each" << endl;
+}
+
+// Measure query evaluation throughput.
+void benchmarkQueries(const CatalogIndex& index) {
+    const vector<string> queries = {
+        "department in (AAA, AAB, ABC) and level >= 300 and has no prerequisites",
+        "level = 500 or prerequisites >= 3",
+        "not (number < 200) and title contains \"9\"",
+        "credits >= 3 and terms contains fall and campus != online",
+    };
+
+    cout << "Query evaluation:" << endl;
+    for (const string& text : queries) {
+        string error;
+        QueryPredicate predicate = prepareQuery(text, index, error);
+        if (!predicate) {
+            cout << "  Query error: " << error << endl;
+            continue;
+        }
+
+        size_t evaluated = 0;
+        size_t matched = 0;
+        auto start = chrono::steady_clock::now();
+        do {
+            matched = runQuery(predicate, index).size();
+            evaluated += index.size();
+        } while (secondsSince(start) < 0.25);
+        double seconds = secondsSince(start);
+
+        cout << "  " << text << " (" << matched << " matches)" << endl;
+        printRate("evaluated", evaluated, seconds, "courses");
+    }
+}
+
+// Compare the column totals against walking the tree and splitting every
+// course number again, which is how a report would otherwise be written.
+void benchmarkCatalogTotals(CourseBST& tree, const CatalogIndex& index) {
+    cout << "Catalog totals:" << endl;
+
+    auto start = chrono::steady_clock::now();
+    vector<Course*> courses;
+    tree.collectInOrder(courses);
+    unordered_map<string, uint64_t> walkedCredits;
+    string department;
+    uint32_t number;
+    for (const Course* course : courses) {
+        splitCourseNumber(course->courseNumber, department, number);
+        walkedCredits[department] += course->creditHours;
+    }
+    printRate("tree walk", courses.size(), secondsSince(start), "courses");
+
+    CatalogTotals totals;
+    size_t totalled = 0;
+    start = chrono::steady_clock::now();
+    do {
+        computeCatalogTotals(index, totals);
+        totalled += index.size();
+    } while (secondsSince(start) < 0.25);
+    printRate("columns, " + to_string(workerThreadCount()) + " thread(s)", totalled,
+              secondsSince(start), "courses");
+
+    bool match = walkedCredits.size() == index.departmentNames.size();
+    for (size_t d = 0; match && d < index.departmentNames.size(); ++d) {
+        match = walkedCredits[index.departmentNames[d]] == totals.creditHours[d];
+    }
+    cout << "  credit hours by department " << (match ? "match" : "DIFFER") << endl;
+}
+
+// Measure how long one eligibility check takes for a student who has
+// completed about a third of the catalog.
+void benchmarkEligibility(const CatalogIndex& index) {
+    mt19937_64 random(61);
+    CourseBitmap completed = makeCourseBitmap(index);
+    for (uint32_t id = 0; id < index.size(); ++id) {
+        if (random() % 3 == 0) {
+            setCourseBit(completed, id);
+        }
+    }
+
+    size_t checks = 0;
+    vector<uint32_t> eligible;
+    auto start = chrono::steady_clock::now();
+    do {
+        findEligibleCourses(index, completed, eligible);
+        checks++;
+    } while (secondsSince(start) < 0.25);
+    double seconds = secondsSince(start);
+
+    cout << "Eligibility (" << eligible.size() << " eligible courses):" << endl;
+    cout << "  " << seconds * 1000.0 / checks << " ms per student over "
+         << index.size() << " courses" << endl;
+}
+
+// Measure bulk audit throughput with synthetic students who have each
+// completed a random run of courses.
+void benchmarkDegreeAudit(const CatalogIndex& index) {
+    const size_t studentCount = 64 * 100;
+    mt19937_64 random(62);
+    vector<StudentTranscript> students(studentCount);
+    for (size_t s = 0; s < studentCount; ++s) {
+        uint32_t first = static_cast<uint32_t>(random() % index.size());
+        for (uint32_t id = first; id < index.size() && id < first + 40; ++id) {
+            students[s].completed.push_back(id);
+        }
+    }
+
+    auto start = chrono::steady_clock::now();
+    atomic<size_t> eligibleTotal(0);
+    size_t batchCount = studentCount / 64;
+    parallelFor(batchCount, [&](size_t begin, size_t end) {
+        vector<uint64_t> slices(index.size(), 0);
+        vector<vector<uint32_t>> eligible;
+        for (size_t b = begin; b < end; ++b) {
+            evaluateEligibilityBatch(index, &students[b * 64], 64, slices, eligible);
+            for (const vector<uint32_t>& courses : eligible) {
+                eligibleTotal += courses.size();
+            }
+        }
+    }, 1);
+    double seconds = secondsSince(start);
+
+    cout << "Degree audit:" << endl;
+    printRate("audited", studentCount, seconds, "students");
+}
+
+// Compare lookup throughput on each NUMA node with one shared catalog on
+// the first node and with a copy on every node. Every worker thread is
+// pinned to a node and looks up random courses and walks their
+// prerequisites for a fixed time.
+void benchmarkNumaReplicas(const CatalogIndex& index) {
+    cout << "NUMA catalog replicas:" << endl;
+    size_t workerCount = workerThreadCount();
+    vector<CourseKey> keys(1 << 16);
+    mt19937_64 random(75);
+    for (CourseKey& key : keys) {
+        key = canonicalCourseKey(index.courses[random() % index.size()]->courseNumber);
+    }
+
+    for (bool replicate : { false, true }) {
+        CatalogReplicas replicas;
+        replicas.build(index, replicate);
+        if (replicate && replicas.nodeCount() == 1) {
+            cout << "  (one NUMA node, so the replicated catalog is the same as the shared one)" << endl;
+        }
+
+        vector<size_t> workerLookups(workerCount, 0);
+        atomic<size_t> checksum(0);
+        vector<thread> workers;
+        auto runStart = chrono::steady_clock::now();
+        for (size_t w = 0; w < workerCount; ++w) {
+            workers.emplace_back([&, w]() {
+                const CatalogIndex& catalog = replicas.pinWorker(w);
+                size_t lookups = 0;
+                size_t sum = 0;
+                auto start = chrono::steady_clock::now();
+                do {
+                    for (size_t k = 0; k < 1024; ++k) {
+                        uint32_t id;
+                        if (findCourseId(catalog, keys[(w * 7919 + lookups + k) % keys.size()], id)) {
+                            for (uint32_t e = catalog.prereqStart[id]; e < catalog.prereqStart[id + 1]; ++e) {
+                                sum += catalog.chainLength[catalog.prereqIds[e]];
+                            }
+                        }
+                    }
+                    lookups += 1024;
+                } while (secondsSince(start) < 0.25);
+                workerLookups[w] = lookups;
+                checksum += sum;
+            });
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        double seconds = secondsSince(runStart);
+
+        cout << "  " << (replicate ? "one copy per node:" : "one shared copy on node 0:") << endl;
+        for (size_t node = 0; node < replicas.nodeCount(); ++node) {
+            size_t lookups = 0;
+            size_t threads = 0;
+            for (size_t w = 0; w < workerCount; ++w) {
+                if (replicas.nodeOfWorker(w) == node) {
+                    lookups += workerLookups[w];
+                    threads++;
+                }
+            }
+            printRate("node " + to_string(node) + " (" + to_string(threads) + " threads)",
+                      lookups, seconds, "lookups");
+        }
+    }
+}
+
+// Measure what-if analysis for retiring randomly chosen courses.
+void benchmarkWhatIf(const CatalogIndex& index) {
+    mt19937_64 random(64);
+    const size_t trials = 100;
+    size_t visited = 0;
+    double slowest = 0.0;
+
+    auto start = chrono::steady_clock::now();
+    for (size_t t = 0; t < trials; ++t) {
+        WhatIfChange change;
+        change.courseId = static_cast<uint32_t>(random() % index.size());
+        change.removeCourse = true;
+
+        auto trialStart = chrono::steady_clock::now();
+        visited += analyzeWhatIf(index, change).coursesVisited;
+        slowest = max(slowest, secondsSince(trialStart));
+    }
+    double seconds = secondsSince(start);
+
+    cout << "What-if course removal:" << endl;
+    cout << "  " << seconds * 1000.0 / trials << " ms average, " << slowest * 1000.0
+         << " ms slowest, " << visited / trials << " courses re-evaluated on average" << endl;
+}
+
+// Compare the sequential and parallel curriculum layering.
+void benchmarkCurriculumLevels(const CatalogIndex& index) {
+    cout << "Curriculum levels:" << endl;
+
+    CurriculumLevels sequential;
+    auto start = chrono::steady_clock::now();
+    computeCurriculumLevelsSequential(index, sequential);
+    printRate("sequential", index.size(), secondsSince(start), "courses");
+
+    CurriculumLevels parallel;
+    start = chrono::steady_clock::now();
+    computeCurriculumLevels(index, parallel);
+    printRate(to_string(workerThreadCount()) + " thread(s)", index.size(), secondsSince(start),
+              "courses");
+
+    cout << "  " << sequential.levelCount() << " levels; results "
+         << (sequential.level == parallel.level ? "match" : "DIFFER") << endl;
+}
+
+// Measure overlap searches and conflict-free schedule searches over a
+// term's worth of synthetic sections: eight per course for the first
+// 2000 courses, with random meeting times.
+void benchmarkSections(const CatalogIndex& index) {
+    mt19937_64 random(70);
+    const uint8_t patterns[] = { 0x15, 0x0A, 0x05, 0x10 };   // MWF, TR, MW, F
+    const size_t sectionCourses = min<size_t>(index.size(), 2000);
+    const size_t sectionsPerCourse = 8;
+    vector<Section> loaded;
+    loaded.reserve(sectionCourses * sectionsPerCourse);
+    for (size_t id = 0; id < sectionCourses; ++id) {
+        for (size_t s = 0; s < sectionsPerCourse; ++s) {
+            Section section;
+            section.courseNumber = index.courses[id]->courseNumber;
+            section.name = to_string(s + 1);
+            section.days = patterns[random() % 4];
+            section.start = static_cast<uint16_t>(8 * 60 + random() % 24 * 30);
+            section.end = static_cast<uint16_t>(section.start + (section.days == 0x0A ? 75 : 50));
+            loaded.push_back(move(section));
+        }
+    }
+
+    cout << "Section times:" << endl;
+    SectionIndex sectionIndex;
+    auto start = chrono::steady_clock::now();
+    sectionIndex.build(loaded, index);
+    printRate("index build", loaded.size(), secondsSince(start), "sections");
+
+    const size_t searches = 10000;
+    size_t overlaps = 0;
+    vector<uint32_t> overlapping;
+    start = chrono::steady_clock::now();
+    for (size_t q = 0; q < searches; ++q) {
+        sectionIndex.findOverlapping(sectionIndex.sections[random() % sectionIndex.sections.size()],
+                                     overlapping);
+        overlaps += overlapping.size();
+    }
+    printRate("overlap search", searches, secondsSince(start), "searches");
+    cout << "    " << overlaps / searches << " overlapping sections on average" << endl;
+
+    const size_t trials = 100;
+    size_t schedules = 0;
+    double slowest = 0.0;
+    vector<vector<uint32_t>> kept;
+    start = chrono::steady_clock::now();
+    for (size_t t = 0; t < trials; ++t) {
+        vector<uint32_t> courseIds;
+        while (courseIds.size() < 5) {
+            uint32_t id = static_cast<uint32_t>(random() % sectionCourses);
+            if (find(courseIds.begin(), courseIds.end(), id) == courseIds.end()) {
+                courseIds.push_back(id);
+            }
+        }
+        auto trialStart = chrono::steady_clock::now();
+        schedules += findConflictFreeSchedules(sectionIndex, courseIds, 20, kept);
+        slowest = max(slowest, secondsSince(trialStart));
+    }
+    cout << "  conflict-free schedules for 5 courses: "
+         << secondsSince(start) * 1000.0 / trials << " ms average, " << slowest * 1000.0
+         << " ms slowest, " << schedules / trials << " schedules on average" << endl;
+}
+
+// Compare the cost of single-course edits to the closure against full
+// rebuilds on catalogs of increasing size. The closure needs
+// courses * courses bits, so these catalogs are kept small.
+void benchmarkClosure() {
+    cout << "Transitive closure (edit vs. full rebuild):" << endl;
+    for (size_t courseCount : { 1000, 4000, 16000 }) {
+        CourseBST tree;
+        tree.buildFromSorted(makeSyntheticCatalog(courseCount, 65));
+        tree.setSourceHash(courseCount);
+        CatalogIndex index;
+        buildCatalogIndex(tree, index);
+
+        PrerequisiteClosure closure;
+        auto start = chrono::steady_clock::now();
+        closure.build(index);
+        double buildSeconds = secondsSince(start);
+
+        // Point random late courses at a different early prerequisite.
+        mt19937_64 random(65);
+        const size_t edits = 200;
+        size_t updated = 0;
+        size_t rebuilds = 0;
+        start = chrono::steady_clock::now();
+        for (size_t e = 0; e < edits; ++e) {
+            size_t id = courseCount / 2 + random() % (courseCount / 2);
+            string prereq = index.courses[random() % (courseCount / 2)]->courseNumber;
+            closure.setPrerequisites(index.courses[id]->courseNumber, { prereq }, "");
+            updated += closure.lastCoursesUpdated();
+            rebuilds += closure.lastEditRebuilt() ? 1 : 0;
+        }
+        double editSeconds = secondsSince(start) / edits;
+
+        cout << "  " << courseCount << " courses: rebuild " << buildSeconds * 1000.0
+             << " ms, edit " << editSeconds * 1000.0 << " ms (" << updated / edits
+             << " courses updated on average, " << rebuilds << " of " << edits
+             << " edits fell back to a rebuild)" << endl;
+    }
+}
+
+// Compare restoring the catalog from a snapshot with parsing it from a
+// course file, and measure journal appends from one thread and from
+// several threads sharing group commits. The files are written to the
+// system's temporary folder and removed afterwards.
+void benchmarkJournal(CourseBST& tree) {
+    cout << "Snapshot and journal:" << endl;
+    error_code error;
+    filesystem::path directory = filesystem::temp_directory_path(error) / "abcu_benchmark";
+    filesystem::create_directories(directory, error);
+    string snapshotPath = (directory / "catalog.snapshot").string();
+    string journalPath = (directory / "catalog.journal").string();
+
+    vector<Course*> current;
+    tree.collectInOrder(current);
+    vector<Course> courses;
+    string csv;
+    for (Course* course : current) {
+        courses.push_back(*course);
+        csv += course->courseNumber + "," + course->courseTitle;
+        for (const string& prereq : course->prerequisites) {
+            csv += "," + prereq;
+        }
+        csv += "\n";
+    }
+
+    auto start = chrono::steady_clock::now();
+    ParsedCatalogFile parsed;
+    parseCatalogContents(csv, parsed);
+    printRate("course file parse", parsed.courses.size(), secondsSince(start), "courses");
+
+    start = chrono::steady_clock::now();
+    if (!writeSnapshot(snapshotPath, 0, 0, courses)) {
+        cout << "  Could not write " << snapshotPath << endl;
+        return;
+    }
+    printRate("snapshot write", courses.size(), secondsSince(start), "courses");
+
+    uint64_t baseHash;
+    uint64_t sequence;
+    vector<Course> restored;
+    string readError;
+    start = chrono::steady_clock::now();
+    readSnapshot(snapshotPath, baseHash, sequence, restored, readError);
+    printRate("snapshot read", restored.size(), secondsSince(start), "courses");
+
+    // Every thread rewrites the prerequisites of existing courses.
+    const size_t recordsPerThread = 200;
+    for (size_t threadCount : { 1, 8 }) {
+        filesystem::remove(journalPath, error);
+        CatalogJournal journal;
+        if (!journal.open(journalPath)) {
+            cout << "  Could not open " << journalPath << endl;
+            break;
+        }
+
+        atomic<uint64_t> nextSequence(1);
+        auto appendWorker = [&](size_t worker) {
+            for (size_t r = 0; r < recordsPerThread; ++r) {
+                CatalogEdit edit;
+                edit.sequence = nextSequence++;
+                edit.kind = EditKind::Update;
+                edit.course = courses[(worker * recordsPerThread + r) % courses.size()];
+                journal.append(encodeJournalRecord(edit));
+            }
+        };
+
+        start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (size_t t = 0; t < threadCount; ++t) {
+            workers.emplace_back(appendWorker, t);
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        double seconds = secondsSince(start);
+        printRate("journal append, " + to_string(threadCount) + " thread(s)",
+                  threadCount * recordsPerThread, seconds, "records");
+        cout << "    " << journal.syncCount() << " syncs" << endl;
+    }
+
+    vector<CatalogEdit> edits;
+    uint64_t validBytes;
+    start = chrono::steady_clock::now();
+    readJournal(journalPath, 0, edits, validBytes);
+    for (CatalogEdit& edit : edits) {
+        string editError;
+        if (validateCatalogEdit(tree, edit, editError)) {
+            applyCatalogEdit(tree, edit);
+        }
+    }
+    printRate("journal replay", edits.size(), secondsSince(start), "records");
+
+    filesystem::remove_all(directory, error);
+}
+
+// Compare archive lookups with a cache too small to hold the tree and the
+// operating system's cache dropped against lookups once every page is
+// cached, and measure a scan over the whole archive.
+void benchmarkArchive(CourseBST& tree) {
+    cout << "Disk archive:" << endl;
+    error_code error;
+    filesystem::path directory = filesystem::temp_directory_path(error) / "abcu_benchmark";
+    filesystem::create_directories(directory, error);
+    string archivePath = (directory / "catalog.archive").string();
+
+    vector<Course*> courses;
+    tree.collectInOrder(courses);
+    string buildError;
+    ArchiveBuilder builder;
+    auto start = chrono::steady_clock::now();
+    bool built = builder.open(archivePath, buildError);
+    for (size_t i = 0; built && i < courses.size(); ++i) {
+        built = builder.add(*courses[i], buildError);
+    }
+    built = built && builder.finish(buildError);
+    if (!built) {
+        cout << "  " << buildError << endl;
+        return;
+    }
+    printRate("bulk build", courses.size(), secondsSince(start), "courses");
+    uint64_t fileSize = filesystem::file_size(archivePath, error);
+    cout << "    " << fileSize / archivePageSize << " pages of " << archivePageSize << " bytes" << endl;
+
+    mt19937_64 random(73);
+    const size_t lookups = 20000;
+    vector<string> numbers(lookups);
+    for (string& number : numbers) {
+        number = courses[random() % courses.size()]->courseNumber;
+    }
+
+    // 64 frames hold the upper levels of the tree but few of its leaves.
+    ArchiveReader reader;
+    if (!reader.open(archivePath, 64, buildError)) {
+        cout << "  " << buildError << endl;
+        return;
+    }
+    reader.dropOsCache();
+    Course course;
+    size_t found = 0;
+    start = chrono::steady_clock::now();
+    for (const string& number : numbers) {
+        found += reader.find(number, course);
+    }
+    double seconds = secondsSince(start);
+    printRate("cold lookup (64-page cache)", lookups, seconds, "lookups");
+    cout << "    " << seconds * 1e6 / lookups << " us per lookup, "
+         << static_cast<double>(reader.pageReads()) / lookups << " page reads per lookup" << endl;
+
+    reader.open(archivePath, fileSize / archivePageSize + 1, buildError);
+    for (const string& number : numbers) {
+        found += reader.find(number, course);
+    }
+    uint64_t readsBefore = reader.pageReads();
+    start = chrono::steady_clock::now();
+    for (const string& number : numbers) {
+        found += reader.find(number, course);
+    }
+    seconds = secondsSince(start);
+    printRate("warm lookup (every page cached)", lookups, seconds, "lookups");
+    cout << "    " << seconds * 1e6 / lookups << " us per lookup, "
+         << reader.pageReads() - readsBefore << " page reads" << endl;
+    cout << "    " << found / 3 << " of " << lookups << " found by each" << endl;
+
+    reader.open(archivePath, 64, buildError);
+    size_t scanned = 0;
+    start = chrono::steady_clock::now();
+    reader.scan("", "", [&scanned](const Course&) {
+        scanned++;
+        return true;
+    });
+    printRate("in-order scan", scanned, secondsSince(start), "courses");
+
+    filesystem::remove(archivePath, error);
+}
+
+// Build the tree with each page backing for its nodes and compare the
+// latency and data TLB misses of random lookups, which follow a pointer
+// to a different node at every level.
+void benchmarkPageBacking(size_t courseCount) {
+    cout << "Tree node pages:" << endl;
+    vector<Course> courses = makeSyntheticCatalog(courseCount, 320);
+
+    mt19937_64 random(74);
+    const size_t lookups = 1000000;
+    vector<CourseKey> keys(lookups);
+    for (CourseKey& key : keys) {
+        key = canonicalCourseKey(courses[random() % courses.size()].courseNumber);
+    }
+
+    TlbMissCounter tlbMisses;
+    if (!tlbMisses.available()) {
+        cout << "  (data TLB miss counts are not available on this system)" << endl;
+    }
+
+    for (PageBacking backing : { PageBacking::Small, PageBacking::Transparent, PageBacking::Explicit }) {
+        CourseBST tree;
+        tree.setPageBacking(backing);
+        tree.buildFromSorted(courses);
+
+        size_t found = 0;
+        tlbMisses.start();
+        auto start = chrono::steady_clock::now();
+        for (const CourseKey& key : keys) {
+            found += tree.search(key.view()) != nullptr;
+        }
+        double seconds = secondsSince(start);
+        uint64_t misses = tlbMisses.stop();
+
+        string label = pageBackingName(backing);
+        if (tree.getPageBacking() != backing) {
+            label += string(" (fell back to ") + pageBackingName(tree.getPageBacking()) + ")";
+        }
+        printRate(label, lookups, seconds, "lookups");
+        cout << "    " << seconds * 1e9 / lookups << " ns per lookup";
+        if (tlbMisses.available()) {
+            cout << ", " << static_cast<double>(misses) / lookups << " data TLB misses per lookup";
+        }
+        cout << ", " << anonHugePagesKb() / 1024 << " MB in transparent huge pages" << endl;
+        if (found != lookups) {
+            cout << "    only " << found << " found" << endl;
+        }
+    }
+}
+
+// Run every benchmark on a synthetic catalog with the given number of courses.
+void runBenchmarks(size_t courseCount) {
+    cout << "Benchmarking with " << courseCount << " synthetic courses." << endl;
+
+    auto start = chrono::steady_clock::now();
+    CourseBST tree;
+    tree.buildFromSorted(makeSyntheticCatalog(courseCount, 320));
+    tree.setSourceHash(courseCount);
+    CatalogIndex index;
+    buildCatalogIndex(tree, index);
+    printRate("catalog build", courseCount, secondsSince(start), "courses");
+
+    benchmarkLookups(tree, index);
+    benchmarkPageBacking(courseCount);
+    benchmarkQueries(index);
+    benchmarkCatalogTotals(tree, index);
+
+    cout << "Prerequisite graph:" << endl;
+    start = chrono::steady_clock::now();
+    computePrerequisiteRank(index, 30, 0.0);
+    printRate("prerequisite rank (30 iterations)", index.prereqIds.size() * 30,
+              secondsSince(start), "edges");
+
+    benchmarkEligibility(index);
+    benchmarkDegreeAudit(index);
+    benchmarkNumaReplicas(index);
+    benchmarkWhatIf(index);
+    benchmarkCurriculumLevels(index);
+    benchmarkSections(index);
+    benchmarkClosure();
+    benchmarkJournal(tree);
+    benchmarkArchive(tree);
+}
+
+// -----------------------------
+// Self-tests
+// -----------------------------
+
+// A small catalog with known answers. B200 to B400 form a long chain and
+// X100/X200 a cycle, so rules can be checked against short, long and
+// untakeable alternatives. CS300 and CS400 require each other, so CS500
+// can only be reached through CS200.
+const char* const selfTestCatalog =
+    "A100,Base\n"
+    "B200,Long 1,A100\n"
+    "B300,Long 2,B200\n"
+    "B400,Long 3,B300\n"
+    "C100,Short\n"
+    "X100,Cycle 1,X200\n"
+    "X200,Cycle 2,X100\n"
+    "R500,Either,B400 or C100\n"
+    "S500,Cycle Or,X100 or A100\n"
+    "T500,Both,B400,C100\n"
+    "U500,None,X100 or X200\n"
+    "V500,Nested,(B400 or C100) and (X100 or B200)\n"
+    "CS100,Intro\n"
+    "CS200,Data Structures,CS100\n"
+    "CS300,Algorithms,CS400\n"
+    "CS400,Theory,CS300\n"
+    "CS500,Capstone,CS200 or CS300\n";
+
+// Counts the checks a self-test makes and prints the ones that fail.
+class SelfTest {
+public:
+    explicit SelfTest(const string& testName) : name(testName) {}
+
+    void check(bool passed, const string& what) {
+        checks++;
+        if (!passed) {
+            failures++;
+            cout << "  FAIL: " << what << endl;
+        }
+    }
+
+    // Print the result. Returns true if every check passed.
+    bool report() const {
+        cout << name << ": " << (failures == 0 ? "passed" : "FAILED") << " ("
+             << checks - failures << " of " << checks << " checks)" << endl;
+        return failures == 0;
+    }
+
+private:
+    string name;
+    size_t checks = 0;
+    size_t failures = 0;
+};
+
+// Load catalog text the same way as a course file.
+void loadSelfTestCatalog(const string& csv, CourseBST& tree, CatalogIndex& index) {
+    ParsedCatalogFile parsed;
+    parseCatalogContents(csv, parsed);
+    tree.clear();
+    tree.buildFromSorted(move(parsed.courses));
+    tree.setSourceHash(hashContents(csv));
+    buildCatalogIndex(tree, index);
+}
+
+// Look up a course ID, or noCourse if the number is not in the catalog.
+uint32_t selfTestId(const CatalogIndex& index, const string& number) {
+    uint32_t id;
+    return findCourseId(index, number, id) ? id : CatalogIndex::noCourse;
+}
+
+// The course numbers of a list of course IDs, in ID order, for comparing
+// results with expected lists.
+vector<string> selfTestNumbers(const CatalogIndex& index, vector<uint32_t> ids) {
+    sort(ids.begin(), ids.end());
+    vector<string> numbers;
+    for (uint32_t id : ids) {
+        numbers.push_back(index.courses[id]->courseNumber);
+    }
+    return numbers;
+}
+
+// A completed-course bitmap for a list of course numbers.
+CourseBitmap selfTestCompleted(const CatalogIndex& index, const vector<string>& numbers) {
+    CourseBitmap completed = makeCourseBitmap(index);
+    for (const string& number : numbers) {
+        setCourseBit(completed, selfTestId(index, number));
+    }
+    return completed;
+}
+
+// Check the courses a student can take next, with and without rules.
+bool selfTestEligibility(const CatalogIndex& index) {
+    SelfTest test("Eligibility");
+    const pair<vector<string>, vector<string>> cases[] = {
+        { {}, { "A100", "C100", "CS100" } },
+        { { "A100", "C100" }, { "B200", "CS100", "R500", "S500" } },
+        { { "A100", "B200", "C100", "CS100" }, { "B300", "CS200", "R500", "S500", "V500" } },
+        { { "A100", "B200", "B300", "B400", "C100" }, { "CS100", "R500", "S500", "T500", "V500" } },
+    };
+    vector<uint32_t> eligible;
+    for (const auto& testCase : cases) {
+        findEligibleCourses(index, selfTestCompleted(index, testCase.first), eligible);
+        string completed;
+        for (const string& number : testCase.first) {
+            completed += " " + number;
+        }
+        test.check(selfTestNumbers(index, eligible) == testCase.second,
+                   "eligible courses after" + (completed.empty() ? string(" nothing") : completed));
+    }
+    return test.report();
+}
+
+// Audit a transcripts file of 130 students, so the batches of 64 include
+// a partial one, and check each output line against the single-student
+// eligibility check. The first students also have known answers,
+// including course numbers in other spellings and one not in the catalog.
+bool selfTestDegreeAudit(const CatalogIndex& index) {
+    SelfTest test("Degree audit");
+    error_code error;
+    filesystem::path directory = filesystem::temp_directory_path(error) / "abcu_self_test";
+    filesystem::create_directories(directory, error);
+    string transcriptPath = (directory / "transcripts.csv").string();
+
+    const vector<vector<string>> transcripts = {
+        { "A100", "C100" },
+        { "a100", " B200 ", "C100", "cs-100" },
+        { "NOPE999" },
+        {},
+    };
+    {
+        ofstream output(transcriptPath);
+        for (size_t s = 0; s < 130; ++s) {
+            output << "S" << s;
+            for (const string& number : transcripts[s % transcripts.size()]) {
+                output << "," << number;
+            }
+            output << "\n";
+        }
+    }
+
+    ostringstream out;
+    AuditSummary summary;
+    test.check(runDegreeAudit(index, transcriptPath, out, summary), "audit runs");
+    test.check(summary.students == 130, "130 students audited");
+
+    istringstream lines(out.str());
+    string line;
+    vector<uint32_t> eligible;
+    size_t s = 0;
+    for (; getline(lines, line); ++s) {
+        vector<string> expected = { "S" + to_string(s) };
+        vector<string> completed;
+        for (const string& number : transcripts[s % transcripts.size()]) {
+            uint32_t id;
+            if (findCourseId(index, number, id)) {
+                completed.push_back(index.courses[id]->courseNumber);
+            }
+        }
+        findEligibleCourses(index, selfTestCompleted(index, completed), eligible);
+        for (const string& number : selfTestNumbers(index, eligible)) {
+            expected.push_back(number);
+        }
+        if (split(line, ',') != expected) {
+            test.check(false, "line for student S" + to_string(s) + ": " + line);
+        }
+    }
+    test.check(s == 130, "one line per student");
+
+    istringstream first(out.str());
+    getline(first, line);
+    test.check(line == "S0,B200,CS100,R500,S500", "student S0");
+    getline(first, line);
+    test.check(line == "S1,B300,CS200,R500,S500,V500", "student S1");
+    getline(first, line);
+    test.check(line == "S2,A100,C100,CS100", "student S2");
+    test.check(summary.unknownCourses == 32, "NOPE999 counted as unknown for 32 students");
+
+    filesystem::remove_all(directory, error);
+    return test.report();
+}
+
+// Check the minimum number of terms for each course of the fixed
+// catalog. OR takes the shortest alternative that can be taken, AND the
+// longest, and a rule with no alternative that can be taken gives 0.
+bool selfTestPrerequisiteChains(const CatalogIndex& index) {
+    SelfTest test("Prerequisite chains");
+    const pair<const char*, uint32_t> expected[] = {
+        { "A100", 1 }, { "B400", 4 }, { "R500", 2 }, { "S500", 2 }, { "T500", 5 },
+        { "U500", 0 }, { "V500", 3 }, { "X100", 0 }, { "CS500", 3 }, { "CS300", 0 },
+    };
+    for (const auto& course : expected) {
+        uint32_t terms = index.chainLength[selfTestId(index, course.first)];
+        test.check(terms == course.second,
+                   string(course.first) + " needs " + to_string(terms) + " terms");
+    }
+    test.check(index.chainPrevious[selfTestId(index, "R500")] == selfTestId(index, "C100"),
+               "R500 is reached through C100");
+    test.check(index.longestChainEnd == selfTestId(index, "T500"), "the longest chain ends at T500");
+    return test.report();
+}
+
+// Describe a what-if result as text such as "blocked: T500; available:
+// R500 V500; terms: R500 2->5 V500 3->5", for comparing with the
+// expected result.
+string describeWhatIf(const CatalogIndex& index, const WhatIfImpact& impact) {
+    if (impact.createsCycle) {
+        return "cycle";
+    }
+    string text = "blocked:";
+    for (const string& number : selfTestNumbers(index, impact.blocked)) {
+        text += " " + number;
+    }
+    text += "; available:";
+    for (const string& number : selfTestNumbers(index, impact.stillAvailable)) {
+        text += " " + number;
+    }
+    text += "; terms:";
+    vector<ChainChange> changes = impact.chainChanges;
+    sort(changes.begin(), changes.end(), [](const ChainChange& a, const ChainChange& b) {
+        return a.id < b.id;
+    });
+    for (const ChainChange& chainChange : changes) {
+        text += " " + index.courses[chainChange.id]->courseNumber + " "
+              + to_string(chainChange.oldTerms) + "->" + to_string(chainChange.newTerms);
+    }
+    return text;
+}
+
+// Check what-if results for removing a course, lengthening a course's
+// prerequisites and creating a cycle. Rule courses that keep another
+// alternative must be reported as still available, not blocked.
+bool selfTestWhatIf(const CatalogIndex& index) {
+    SelfTest test("What-if analysis");
+
+    WhatIfChange removeC100;
+    removeC100.courseId = selfTestId(index, "C100");
+    removeC100.removeCourse = true;
+    string result = describeWhatIf(index, analyzeWhatIf(index, removeC100));
+    test.check(result == "blocked: T500; available: R500 V500; terms: R500 2->5 V500 3->5",
+               "remove C100 gives " + result);
+
+    WhatIfChange lengthenC100;
+    lengthenC100.courseId = selfTestId(index, "C100");
+    lengthenC100.newPrereqs = { selfTestId(index, "B200") };
+    result = describeWhatIf(index, analyzeWhatIf(index, lengthenC100));
+    test.check(result == "blocked:; available: R500 T500 V500; terms: C100 1->3 R500 2->4 V500 3->4",
+               "C100 after B200 gives " + result);
+
+    WhatIfChange removeCS200;
+    removeCS200.courseId = selfTestId(index, "CS200");
+    removeCS200.removeCourse = true;
+    result = describeWhatIf(index, analyzeWhatIf(index, removeCS200));
+    test.check(result == "blocked: CS500; available:; terms:", "remove CS200 gives " + result);
+
+    WhatIfChange cycle;
+    cycle.courseId = selfTestId(index, "C100");
+    cycle.newPrereqs = { selfTestId(index, "R500") };
+    result = describeWhatIf(index, analyzeWhatIf(index, cycle));
+    test.check(result == "cycle", "C100 after R500 gives " + result);
+    return test.report();
+}
+
+// Check the courses the closure reports as required, then edit a copy
+// of the catalog and check that the closure updated in place matches one
+// built from scratch after every edit.
+bool selfTestClosure(const CatalogIndex& index) {
+    SelfTest test("Prerequisite closure");
+    PrerequisiteClosure closure;
+    closure.build(index);
+
+    auto required = [&closure](const string& number) {
+        string text;
+        for (const string& prereq : closure.allPrerequisites(number)) {
+            text += (text.empty() ? "" : " ") + prereq;
+        }
+        return text;
+    };
+    const pair<const char*, const char*> expected[] = {
+        { "A100", "" },
+        { "B400", "A100 B200 B300" },
+        { "R500", "" },
+        { "S500", "A100" },
+        { "T500", "A100 B200 B300 B400 C100" },
+        { "V500", "A100 B200" },
+        { "CS500", "CS100 CS200" },
+    };
+    for (const auto& course : expected) {
+        string result = required(course.first);
+        test.check(result == course.second, string(course.first) + " requires \"" + result + "\"");
+    }
+    test.check(closure.dependsOn("CS500", "CS100") && !closure.dependsOn("CS500", "CS300"),
+               "CS500 depends on CS100 but not on CS300");
+
+    // Each edit is applied to the closure and to the catalog lines, which
+    // are then loaded into a fresh tree for the full rebuild. The closure
+    // is never allowed to fall back to a rebuild of its own.
+    struct Edit {
+        const char* number;
+        const char* line;   // the course's new line, or nullptr to remove it
+    };
+    const Edit edits[] = {
+        { "C100", "C100,Short,B200" },
+        { "Z900", "Z900,Late,CS500 or R500" },
+        { "CS300", "CS300,Algorithms,CS100" },
+        { "B200", nullptr },
+        { "B200", "B200,Long 1,A100 or CS200" },
+    };
+    unordered_map<string, string> lines;
+    for (const string& line : split(selfTestCatalog, '\n')) {
+        if (!line.empty()) {
+            lines[split(line, ',')[0]] = line;
+        }
+    }
+    closure.rebuildFraction = 1.0;
+    for (const Edit& edit : edits) {
+        bool updated;
+        if (edit.line == nullptr) {
+            updated = closure.removeCourse(edit.number);
+            lines.erase(edit.number);
+        }
+        else {
+            Course course;
+            string messages;
+            parseCourseLine(edit.line, course, messages);
+            updated = lines.count(edit.number) != 0
+                          ? closure.setPrerequisites(edit.number, course.prerequisites,
+                                                     course.prerequisiteRule)
+                          : closure.insertCourse(edit.number, course.prerequisites,
+                                                 course.prerequisiteRule);
+            lines[edit.number] = edit.line;
+        }
+        test.check(updated && !closure.lastEditRebuilt(),
+                   string("edit of ") + edit.number + " is applied in place");
+
+        string csv;
+        for (const auto& line : lines) {
+            csv += line.second + "\n";
+        }
+
+        CourseBST editedTree;
+        CatalogIndex editedIndex;
+        loadSelfTestCatalog(csv, editedTree, editedIndex);
+        PrerequisiteClosure rebuilt;
+        rebuilt.build(editedIndex);
+        bool same = closure.size() == rebuilt.size();
+        for (const Course* course : editedIndex.courses) {
+            same = same && closure.allPrerequisites(course->courseNumber)
+                               == rebuilt.allPrerequisites(course->courseNumber);
+        }
+        test.check(same, string("closure after the edit of ") + edit.number + " matches a rebuild");
+    }
+    return test.report();
+}
+
+// Check the levels of the fixed catalog, then check that the parallel
+// layering matches the sequential one on a synthetic catalog where every
+// third course with two or more prerequisites has an OR rule. The thread
+// count is forced so the parallel code runs even on one core.
+bool selfTestCurriculumLevels(const CatalogIndex& index) {
+    SelfTest test("Curriculum levels");
+    CurriculumLevels levels;
+    computeCurriculumLevelsSequential(index, levels);
+
+    const pair<const char*, uint32_t> expected[] = {
+        { "A100", 0 }, { "C100", 0 }, { "B200", 1 }, { "R500", 1 }, { "S500", 1 },
+        { "B300", 2 }, { "V500", 2 }, { "B400", 3 }, { "T500", 4 }, { "CS100", 0 },
+        { "CS200", 1 }, { "CS500", 2 }, { "U500", CatalogIndex::noCourse },
+        { "X100", CatalogIndex::noCourse }, { "CS300", CatalogIndex::noCourse },
+    };
+    for (const auto& course : expected) {
+        uint32_t id = selfTestId(index, course.first);
+        uint32_t level = id == CatalogIndex::noCourse ? id : levels.level[id];
+        test.check(level == course.second,
+                   string(course.first) + " is on level "
+                       + (level == CatalogIndex::noCourse ? "none" : to_string(level)));
+    }
+
+    vector<Course> courses = makeSyntheticCatalog(20000, 67);
+    for (size_t i = 0; i < courses.size(); i += 3) {
+        vector<string>& prereqs = courses[i].prerequisites;
+        if (prereqs.size() >= 2) {
+            vector<string> rule = { prereqs[0], prereqs[1], "OR" };
+            for (size_t p = 2; p < prereqs.size(); ++p) {
+                rule.insert(rule.end(), { prereqs[p], "AND" });
+            }
+            courses[i].prerequisiteRule = formatPrerequisiteRule(rule, [](const string& number) {
+                return number;
+            });
+        }
+    }
+    CourseBST syntheticTree;
+    syntheticTree.buildFromSorted(move(courses));
+    CatalogIndex synthetic;
+    buildCatalogIndex(syntheticTree, synthetic);
+
+    CurriculumLevels sequential;
+    CurriculumLevels parallel;
+    computeCurriculumLevelsSequential(synthetic, sequential);
+    computeCurriculumLevels(synthetic, parallel, 4);
+    test.check(sequential.level == parallel.level,
+               "parallel levels match sequential levels on a catalog with rules");
+    return test.report();
+}
+
+// Check section overlaps and conflict-free schedules on a few sections of
+// the fixed catalog. A section that ends when another starts does not
+// overlap it. The interval trees are also checked against comparing
+// every pair of sections.
+bool selfTestSections(const CatalogIndex& index) {
+    SelfTest test("Section times");
+    const char* const lines[][5] = {
+        { "A100", "01", "MWF", "9:00", "9:50" },
+        { "A100", "02", "TR", "10:00", "11:15" },
+        { "B200", "01", "MWF", "9:30", "10:20" },
+        { "B200", "02", "MW", "13:00", "14:15" },
+        { "C100", "01", "TR", "11:00", "12:00" },
+        { "C100", "02", "F", "9:50", "10:40" },
+    };
+    vector<Section> loaded;
+    for (const auto& line : lines) {
+        Section section;
+        section.courseNumber = line[0];
+        section.name = line[1];
+        bool parsed = parseMeetingDays(line[2], section.days)
+                      && parseMeetingTime(line[3], section.start)
+                      && parseMeetingTime(line[4], section.end);
+        test.check(parsed, "parse " + string(line[0]) + "-" + line[1]);
+        loaded.push_back(section);
+    }
+    SectionIndex sectionIndex;
+    sectionIndex.build(loaded, index);
+
+    bool treesMatch = true;
+    vector<uint32_t> overlapping;
+    for (uint32_t s = 0; s < sectionIndex.sections.size(); ++s) {
+        sectionIndex.findOverlapping(sectionIndex.sections[s], overlapping);
+        vector<uint32_t> expected;
+        for (uint32_t other = 0; other < sectionIndex.sections.size(); ++other) {
+            if (sectionsOverlap(sectionIndex.sections[s], sectionIndex.sections[other])) {
+                expected.push_back(other);
+            }
+        }
+        treesMatch = treesMatch && overlapping == expected;
+    }
+    test.check(treesMatch, "interval tree overlaps match a pairwise check");
+
+    auto describeOverlaps = [&](const string& number, const string& name) {
+        uint32_t sectionId = 0;
+        sectionIndex.findSection(selfTestId(index, number), name, sectionId);
+        sectionIndex.findOverlapping(sectionIndex.sections[sectionId], overlapping);
+        string text;
+        for (uint32_t other : overlapping) {
+            if (other != sectionId) {
+                const Section& section = sectionIndex.sections[other];
+                text += (text.empty() ? "" : " ") + section.courseNumber + "-" + section.name;
+            }
+        }
+        return text;
+    };
+    string result = describeOverlaps("A100", "01");
+    test.check(result == "B200-01", "A100-01 overlaps \"" + result + "\"");
+    result = describeOverlaps("C100", "02");
+    test.check(result == "B200-01", "C100-02 overlaps \"" + result + "\"");
+    result = describeOverlaps("B200", "02");
+    test.check(result.empty(), "B200-02 overlaps \"" + result + "\"");
+
+    vector<vector<uint32_t>> schedules;
+    vector<uint32_t> courseIds = { selfTestId(index, "A100"), selfTestId(index, "B200"),
+                                   selfTestId(index, "C100") };
+    size_t found = findConflictFreeSchedules(sectionIndex, courseIds, 10, schedules);
+    vector<string> described;
+    for (const vector<uint32_t>& schedule : schedules) {
+        string text;
+        for (uint32_t sectionId : schedule) {
+            text += (text.empty() ? "" : " ") + sectionIndex.sections[sectionId].name;
+        }
+        described.push_back(text);
+    }
+    sort(described.begin(), described.end());
+    test.check(found == 3 && described == vector<string>{ "01 02 01", "01 02 02", "02 02 02" },
+               "three conflict-free schedules for A100, B200 and C100");
+    return test.report();
+}
+
+// Check that the perfect hash sends every key to its own slot, building
+// it with several threads over enough keys for more than one partition,
+// and that lookups through it agree with binary search on the fixed
+// catalog for present, missing and differently spelled numbers.
+bool selfTestNumberHash(const CatalogIndex& index) {
+    SelfTest test("Perfect hash lookup");
+    vector<Course> courses = makeSyntheticCatalog(150000, 71);
+    vector<string_view> keys;
+    for (const Course& course : courses) {
+        keys.push_back(course.courseNumber);
+    }
+    CourseNumberHash hash;
+    test.check(hash.build(keys, 4) && hash.size() == keys.size(), "hash builds over 150000 keys");
+    vector<bool> used(keys.size(), false);
+    bool minimal = true;
+    for (string_view key : keys) {
+        uint32_t slot = hash.slot(key);
+        minimal = minimal && slot < used.size() && !used[slot];
+        if (slot < used.size()) {
+            used[slot] = true;
+        }
+    }
+    test.check(minimal, "every key has its own slot");
+
+    test.check(!index.numberHashEntry.empty(), "the catalog index uses the perfect hash");
+    vector<string> numbers = { "B199", "ZZZ100", "cs 500", "a-100", "CS5000", "" };
+    for (const Course* course : index.courses) {
+        numbers.push_back(course->courseNumber);
+    }
+    for (const string& number : numbers) {
+        CourseKey key = canonicalCourseKey(number);
+        uint32_t hashed = CatalogIndex::noCourse;
+        uint32_t searched = CatalogIndex::noCourse;
+        bool foundByHash = key.valid && findCourseId(index, key, hashed);
+        bool foundBySearch = key.valid && searchCourseId(index, key, searched);
+        test.check(foundByHash == foundBySearch && (!foundByHash || hashed == searched),
+                   "lookup of \"" + number + "\"");
+    }
+    return test.report();
+}
+
+// Build an archive from the fixed catalog with a repeated course and an
+// ALIAS line added, and check lookups and range scans against the tree.
+// Then damage a leaf's record count and check that the damaged page is
+// refused instead of read past its end.
+bool selfTestArchive(CourseBST& tree) {
+    SelfTest test("Disk archive");
+    error_code error;
+    filesystem::path directory = filesystem::temp_directory_path(error) / "abcu_self_test";
+    filesystem::create_directories(directory, error);
+    string coursePath = (directory / "catalog.csv").string();
+    string archivePath = (directory / "catalog.archive").string();
+
+    // The archive needs its input in course number order.
+    vector<Course*> courses;
+    tree.collectInOrder(courses);
+    {
+        ofstream output(coursePath, ios::binary);
+        for (Course* course : courses) {
+            if (course->courseNumber == "B300") {
+                output << "B300,Replaced title,A100\n";
+            }
+            output << course->courseNumber << "," << course->courseTitle;
+            for (const string& prereq : course->prerequisites) {
+                output << "," << prereq;
+            }
+            output << "\n";
+        }
+        output << "ALIAS,CS200,MATH200\n";
+    }
+
+    uint64_t courseCount = 0;
+    string buildError;
+    test.check(buildArchiveFromFile(coursePath, archivePath, courseCount, buildError),
+               "archive builds: " + buildError);
+    test.check(courseCount == courses.size(), "the repeated course is stored once");
+
+    ArchiveReader reader;
+    string openError;
+    test.check(reader.open(archivePath, 4, openError), "archive opens: " + openError);
+    for (Course* course : courses) {
+        Course found;
+        test.check(reader.find(course->courseNumber, found)
+                       && found.courseTitle == course->courseTitle
+                       && found.prerequisites == course->prerequisites,
+                   "find " + course->courseNumber);
+    }
+    Course missing;
+    test.check(!reader.find("B250", missing), "B250 is not found");
+    test.check(!reader.find("MATH200", missing), "cross-listed MATH200 is not stored");
+
+    vector<string> scanned;
+    reader.scan("B", "CS200", [&scanned](const Course& course) {
+        scanned.push_back(course.courseNumber);
+        return true;
+    });
+    test.check(scanned == vector<string>{ "B200", "B300", "B400", "C100", "CS100", "CS200" },
+               "scan from B to CS200");
+
+    // Claim far more records than a leaf can hold.
+    reader.close();
+    {
+        fstream archive(archivePath, ios::binary | ios::in | ios::out);
+        uint16_t count = 0xffff;
+        archive.seekp(archivePageSize + 2);
+        archive.write(reinterpret_cast<const char*>(&count), 2);
+    }
+    test.check(reader.open(archivePath, 4, openError), "damaged archive opens");
+    test.check(!reader.find("A100", missing), "a damaged leaf is refused");
+
+    filesystem::remove_all(directory, error);
+    return test.report();
+}
+
+// Run every self-test on the fixed catalog. Returns true if all passed.
+bool runSelfTests() {
+    CourseBST tree;
+    CatalogIndex index;
+    loadSelfTestCatalog(selfTestCatalog, tree, index);
+
+    bool passed = true;
+    passed = selfTestEligibility(index) && passed;
+    passed = selfTestDegreeAudit(index) && passed;
+    passed = selfTestPrerequisiteChains(index) && passed;
+    passed = selfTestWhatIf(index) && passed;
+    passed = selfTestClosure(index) && passed;
+    passed = selfTestCurriculumLevels(index) && passed;
+    passed = selfTestSections(index) && passed;
+    passed = selfTestNumberHash(index) && passed;
+    passed = selfTestArchive(tree) && passed;
+
+    cout << (passed ? "All self-tests passed." : "Some self-tests FAILED.") << endl;
+    return passed;
+}
+
+// -----------------------------
+// Menu and main program
+// -----------------------------
+
+// Print the main menu for the user.
+void printMenu() {
+    cout << endl;
+    cout << "*******************************" << endl;
+    cout << "Welcome to the ABCU Course Planner" << endl;
+    cout << "*******************************" << endl;
+    cout << "1. Load Data Structure" << endl;
+    cout << "2. Print Course List" << endl;
+    cout << "3. Print Course" << endl;
+    cout << "4. Print Tree Statistics" << endl;
+    cout << "5. Query Courses" << endl;
+    cout << "6. Print Course List by Title" << endl;
+    cout << "7. Print Course List by Department and Title" << endl;
+    cout << "8. Print Bottleneck Courses" << endl;
+    cout << "10. Print Prerequisite Chain" << endl;
+    cout << "11. Print Courses I Can Take Next" << endl;
+    cout << "12. What-If: Remove a Course or Change Its Prerequisites" << endl;
+    cout << "13. Print All Required Courses" << endl;
+    cout << "14. Add a Course" << endl;
+    cout << "15. Update a Course" << endl;
+    cout << "16. Remove a Course" << endl;
+    cout << "17. Print Curriculum Map" << endl;
+    cout << "18. Print Catalog Totals" << endl;
+    cout << "19. Load Section Times" << endl;
+    cout << "20. Check a Schedule for Time Conflicts" << endl;
+    cout << "21. Find Conflict-Free Schedules" << endl;
+    cout << "9. Exit" << endl;
+    cout << "Please enter your choice: ";
+}
+
+// Print how to run the program from the command line.
+void printUsage() {
+    cout << "Usage:" << endl;
+    cout << "  ProjectTwo [--huge-pages default|off|transparent|explicit] [--tree-stats]" << endl;
+    cout << "  ProjectTwo --query <course files> <query>" << endl;
+    cout << "  ProjectTwo --totals <course files>" << endl;
+    cout << "  ProjectTwo --embed <course files> <output header>" << endl;
+    cout << "  ProjectTwo --archive-build <sorted course file> <archive>" << endl;
+    cout << "  ProjectTwo --archive-find <archive> <course number>" << endl;
+    cout << "  ProjectTwo --archive-range <archive> <first course> <last course>" << endl;
+    cout << "  ProjectTwo [--numa-replicas] --audit <course files> <transcripts file> [output file]"
+         << endl;
+    cout << "  ProjectTwo --benchmark [course count]" << endl;
+    cout << "  ProjectTwo --self-test" << endl;
+}
+
+// Ask the user for a course edit, save it, and bring the catalog index and
+// the prerequisite closure up to date.
+void promptCatalogEdit(EditKind kind, CatalogStore& store, CourseBST& tree,
+                       CatalogIndex& index, PrerequisiteClosure& closure) {
+    CatalogEdit edit;
+    edit.kind = kind;
+
+    string courseNumber;
+    cout << "Please enter the course number: ";
+    getline(cin, courseNumber);
+
+    if (kind == EditKind::Remove) {
+        CourseKey key = canonicalCourseKey(courseNumber);
+        if (!key.valid) {
+            cout << "Course " << toUpper(trim(courseNumber)) << " not found." << endl;
+            return;
+        }
+        edit.course.courseNumber.assign(key.text, key.length);
+    }
+    else {
+        string title;
+        string prereqs;
+        cout << "Please enter the course title: ";
+        getline(cin, title);
+        cout << "Enter its prerequisites separated by commas (blank for none): ";
+        getline(cin, prereqs);
+
+        // The fields are read the same way as a line of a course file.
+        string messages;
+        bool parsed = parseCourseLine(courseNumber + "," + title + "," + prereqs,
+                                      edit.course, messages);
+        cout << messages;
+        if (!parsed) {
+            cout << "The course was not saved." << endl;
+            return;
+        }
+
+        // Credits, terms and campus are not asked for, so an update keeps
+        // the ones the course already has.
+        Course* existing = kind == EditKind::Update ? tree.search(edit.course.courseNumber) : nullptr;
+        if (existing != nullptr) {
+            edit.course.creditHours = existing->creditHours;
+            edit.course.termsOffered = existing->termsOffered;
+            edit.course.campus = existing->campus;
+        }
+    }
+
+    uint64_t previousHash = tree.getSourceHash();
+    string error;
+    if (!store.applyEdit(tree, edit, error)) {
+        cout << error << endl;
+        return;
+    }
+    refreshCatalogIndex(tree, index);
+
+    // A closure that was current before the edit is updated in place
+    // instead of being rebuilt the next time it is used.
+    if (closure.getSourceHash() == previousHash) {
+        const string& number = edit.course.courseNumber;
+        const vector<string>& prereqs = edit.course.prerequisites;
+        const string& rule = edit.course.prerequisiteRule;
+        bool updated = kind == EditKind::Insert ? closure.insertCourse(number, prereqs, rule)
+                     : kind == EditKind::Update ? closure.setPrerequisites(number, prereqs, rule)
+                                                : closure.removeCourse(number);
+        closure.setSourceHash(updated ? tree.getSourceHash() : 0);
+    }
+
+    cout << "Course " << edit.course.courseNumber
+         << (kind == EditKind::Insert ? " added." : kind == EditKind::Update ? " updated." : " removed.")
+         << endl;
+}
+
+int main(int argc, char* argv[]) {
+    CourseBST courseTree;
+    CatalogIndex catalogIndex;
+    PrerequisiteClosure prerequisiteClosure;
+    CatalogStore catalogStore;
+    vector<Section> loadedSections;
+    SectionIndex sectionIndex;
+    bool dataLoaded = false;
+    bool monitorTreeBalance = false;
+    bool replicateCatalog = false;
+
+    // Command-line options:
+    //   --huge-pages <mode>            back the tree's nodes with default,
+    //                                  4 KB (off), transparent or explicit
+    //                                  huge pages; give it before the other
+    //                                  options
+    //   --tree-stats                   print the tree shape after every load
+    //   --numa-replicas                give each NUMA node its own copy of the
+    //                                  catalog for --audit; give it before --audit
+    //   --query <files> <query>        print the courses matching a query and exit
+    //   --totals <files>               print the catalog totals and exit
+    //   --embed <files> <header>       write the catalog as a header for
+    //                                  ABCU_EMBEDDED_CATALOG and exit
+    //   --archive-build <file> <archive>
+    //                                  write a course file sorted by course
+    //                                  number as a disk archive and exit
+    //   --archive-find <archive> <number>
+    //                                  print one course from an archive and exit
+    //   --archive-range <archive> <first> <last>
+    //                                  list the archive's courses from first
+    //                                  to last and exit
+    //   --audit <files> <transcripts> [output]
+    //                                  list the courses each student can take next
+    //   --benchmark [course count]     run the benchmarks and exit
+    //   --self-test                    check results on a small fixed catalog
+    //                                  and exit, with status 1 on a failure
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "--tree-stats") {
+            monitorTreeBalance = true;
+        }
+        else if (option == "--numa-replicas") {
+            replicateCatalog = true;
+        }
+        else if (option == "--huge-pages" && i + 1 < argc) {
+            PageBacking backing;
+            if (!parsePageBacking(argv[i + 1], backing)) {
+                cout << "Unknown page backing: " << argv[i + 1] << endl;
+                printUsage();
+                return 1;
+            }
+            courseTree.setPageBacking(backing);
+            i++;
+        }
+        else if (option == "--query" && i + 2 < argc) {
+            if (!catalogStore.load(expandCatalogPaths(argv[i + 1]), courseTree)) {
+                return 1;
+            }
+            buildCatalogIndex(courseTree, catalogIndex);
+
+            string error;
+            QueryPredicate predicate = prepareQuery(argv[i + 2], catalogIndex, error);
+            if (!predicate) {
+                cout << "Query error: " << error << endl;
+                return 1;
+            }
+
+            auto start = chrono::steady_clock::now();
+            vector<size_t> matches = runQuery(predicate, catalogIndex);
+            double seconds = secondsSince(start);
+
+            for (size_t id : matches) {
+                cout << catalogIndex.courses[id]->courseNumber << ", "
+                     << catalogIndex.courses[id]->courseTitle << endl;
+            }
+            cerr << matches.size() << " of " << catalogIndex.size() << " courses matched in "
+                 << seconds * 1000.0 << " ms ("
+                 << (seconds > 0 ? catalogIndex.size() / seconds : 0.0)
+                 << " courses/second)" << endl;
+            return 0;
+        }
+        else if (option == "--totals" && i + 1 < argc) {
+            if (!catalogStore.load(expandCatalogPaths(argv[i + 1]), courseTree)) {
+                return 1;
+            }
+            buildCatalogIndex(courseTree, catalogIndex);
+            printCatalogTotals(catalogIndex);
+            return 0;
+        }
+        else if (option == "--embed" && i + 2 < argc) {
+            if (!loadCoursesFromFile(argv[i + 1], courseTree)) {
+                return 1;
+            }
+            if (courseTree.isEmpty()) {
+                cerr << "The course files have no courses to embed." << endl;
+                return 1;
+            }
+            if (!writeEmbeddedCatalog(courseTree, argv[i + 1], argv[i + 2])) {
+                cerr << "Error writing file: " << argv[i + 2] << endl;
+                return 1;
+            }
+            cout << "Catalog written to " << argv[i + 2] << "." << endl;
+            return 0;
+        }
+        else if (option == "--archive-build" && i + 2 < argc) {
+            uint64_t courseCount = 0;
+            string error;
+            auto start = chrono::steady_clock::now();
+            if (!buildArchiveFromFile(argv[i + 1], argv[i + 2], courseCount, error)) {
+                cerr << error << endl;
+                return 1;
+            }
+            cout << courseCount << " courses written to " << argv[i + 2] << "." << endl;
+            cerr << "Built in " << secondsSince(start) * 1000.0 << " ms" << endl;
+            return 0;
+        }
+        else if ((option == "--archive-find" && i + 2 < argc)
+                 || (option == "--archive-range" && i + 3 < argc)) {
+            ArchiveReader reader;
+            string error;
+            if (!reader.open(argv[i + 1], 256, error)) {
+                cerr << error << endl;
+                return 1;
+            }
+
+            auto printArchived = [](const Course& course) {
+                cout << course.courseNumber << ", " << course.courseTitle;
+                for (const string& prereq : course.prerequisites) {
+                    cout << ", " << prereq;
+                }
+                cout << endl;
+                return true;
+            };
+            auto start = chrono::steady_clock::now();
+            if (option == "--archive-find") {
+                Course course;
+                if (!reader.find(argv[i + 2], course)) {
+                    cout << "Course " << toUpper(trim(argv[i + 2])) << " not found." << endl;
+                    return 1;
+                }
+                printArchived(course);
+            }
+            else if (!reader.scan(argv[i + 2], argv[i + 3], printArchived)) {
+                cerr << "Could not read " << argv[i + 1] << "." << endl;
+                return 1;
+            }
+            cerr << reader.pageReads() << " pages read in " << secondsSince(start) * 1000.0
+                 << " ms" << endl;
+            return 0;
+        }
+        else if (option == "--audit" && i + 2 < argc) {
+            if (!catalogStore.load(expandCatalogPaths(argv[i + 1]), courseTree)) {
+                return 1;
+            }
+            buildCatalogIndex(courseTree, catalogIndex);
+
+            ofstream outputFile;
+            if (i + 3 < argc) {
+                outputFile.open(argv[i + 3]);
+                if (!outputFile.is_open()) {
+                    cerr << "Error opening file: " << argv[i + 3] << endl;
+                    return 1;
+                }
+            }
+
+            CatalogReplicas replicas;
+            if (replicateCatalog) {
+                replicas.build(catalogIndex, true);
+                cerr << "Catalog copies: " << replicas.replicaCount() << ", one per NUMA node." << endl;
+            }
+
+            AuditSummary summary;
+            auto start = chrono::steady_clock::now();
+            if (!runDegreeAudit(catalogIndex, argv[i + 2], outputFile.is_open() ? outputFile : cout,
+                                summary, replicateCatalog ? &replicas : nullptr)) {
+                return 1;
+            }
+            double seconds = secondsSince(start);
+
+            cerr << "Audited " << summary.students << " students in " << seconds * 1000.0
+                 << " ms (" << (seconds > 0 ? summary.students / seconds : 0.0)
+                 << " students/second); " << summary.eligibleCourses
+                 << " eligible courses found";
+            if (summary.unknownCourses > 0) {
+                cerr << "; " << summary.unknownCourses << " unknown course numbers ignored";
+            }
+            cerr << "." << endl;
+            return 0;
+        }
+        else if (option == "--benchmark") {
+            size_t courseCount = 1000000;
+            if (i + 1 < argc) {
+                courseCount = static_cast<size_t>(stoull(argv[i + 1]));
+            }
+            runBenchmarks(courseCount);
+            return 0;
+        }
+        else if (option == "--self-test") {
+            return runSelfTests() ? 0 : 1;
+        }
+        else {
+            cout << "Unknown option: " << option << endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+#ifdef ABCU_EMBEDDED_CATALOG
+    // The compiled-in catalog is ready without loading a file.
+    loadEmbeddedCatalog(courseTree);
+    buildCatalogIndex(courseTree, catalogIndex);
+    dataLoaded = true;
+    if (monitorTreeBalance) {
+        printTreeBalanceSummary(courseTree);
+    }
+#endif
+
+    string fileName;
+    string userChoice;
+
+    // Loop until the user chooses to exit.
+    while (true) {
+        printMenu();
+        getline(cin, userChoice);
+
+        if (userChoice == "1") {
+            cout << "Enter course data file name (separate several files with ';'," << endl
+                 << "or enter a folder name to load every file in it): ";
+            getline(cin, fileName);
+
+            if (fileName.empty()) {
+                cout << "File name cannot be empty." << endl;
+                continue;
+            }
+
+            dataLoaded = catalogStore.load(expandCatalogPaths(fileName), courseTree);
+            if (dataLoaded) {
+                refreshCatalogIndex(courseTree, catalogIndex);
+            }
+            if (dataLoaded && monitorTreeBalance) {
+                printTreeBalanceSummary(courseTree);
+            }
+        }
+        else if (userChoice == "2") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                cout << endl;
+                cout << "Here is the list of courses:" << endl;
+                courseTree.printInOrder();
+            }
+        }
+        else if (userChoice == "3") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                string searchNumber;
+                cout << "Please enter the course number (for example, CS200): ";
+                getline(cin, searchNumber);
+
+                if (searchNumber.empty()) {
+                    cout << "Course number cannot be empty." << endl;
+                }
+                else {
+                    printCourseInformation(courseTree, searchNumber);
+                }
+            }
+        }
+        else if (userChoice == "4") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                printTreeStatistics(courseTree);
+            }
+        }
+        else if (userChoice == "5") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                string queryText;
+                cout << "Enter a query (for example, department in (CSCI, MATH) and level >= 300): ";
+                getline(cin, queryText);
+
+                if (queryText.empty()) {
+                    cout << "Query cannot be empty." << endl;
+                }
+                else {
+                    printQueryResults(catalogIndex, queryText);
+                }
+            }
+        }
+        else if (userChoice == "6" || userChoice == "7") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                cout << endl;
+                cout << "Here is the list of courses:" << endl;
+                printCourseListing(catalogIndex, userChoice == "6" ? catalogIndex.byTitle
+                                                                   : catalogIndex.byDepartmentTitle);
+            }
+        }
+        else if (userChoice == "8") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                printBottleneckCourses(catalogIndex, 10);
+            }
+        }
+        else if (userChoice == "10") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                string searchNumber;
+                cout << "Please enter the course number (leave blank for the whole catalog): ";
+                getline(cin, searchNumber);
+                printPrerequisiteChain(catalogIndex, trim(searchNumber));
+            }
+        }
+        else if (userChoice == "11") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                string completedList;
+                cout << "Enter your completed courses separated by commas: ";
+                getline(cin, completedList);
+                printEligibleCourses(catalogIndex, completedList);
+            }
+        }
+        else if (userChoice == "12") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                string searchNumber;
+                string newPrereqs;
+                cout << "Please enter the course number: ";
+                getline(cin, searchNumber);
+                cout << "Enter its new prerequisites separated by commas "
+                     << "(blank for none), or REMOVE to retire it: ";
+                getline(cin, newPrereqs);
+                printWhatIfImpact(catalogIndex, searchNumber, newPrereqs);
+            }
+        }
+        else if (userChoice == "13") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                string searchNumber;
+                cout << "Please enter the course number: ";
+                getline(cin, searchNumber);
+
+                // The closure is built the first time it is needed after a load.
+                if (prerequisiteClosure.getSourceHash() != catalogIndex.sourceHash) {
+                    prerequisiteClosure.build(catalogIndex);
+                }
+                printAllRequiredCourses(courseTree, prerequisiteClosure, searchNumber);
+            }
+        }
+        else if (userChoice == "14" || userChoice == "15" || userChoice == "16") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                EditKind kind = userChoice == "14" ? EditKind::Insert
+                              : userChoice == "15" ? EditKind::Update
+                                                   : EditKind::Remove;
+                promptCatalogEdit(kind, catalogStore, courseTree, catalogIndex, prerequisiteClosure);
+            }
+        }
+        else if (userChoice == "17") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                printCurriculumMap(catalogIndex);
+            }
+        }
+        else if (userChoice == "18") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                printCatalogTotals(catalogIndex);
+            }
+        }
+        else if (userChoice == "19") {
+            if (!dataLoaded) {
+                cout << "Please load the data structure first (option 1)." << endl;
+            }
+            else {
+                string sectionFile;
+                cout << "Enter the section times file name: ";
+                getline(cin, sectionFile);
+                if (loadSectionsFromFile(trim(sectionFile), loadedSections)) {
+                    sectionIndex.build(loadedSections, catalogIndex);
+                    cout << sectionIndex.sections.size() << " sections loaded." << endl;
+                    if (sectionIndex.unknownCourseCount() > 0) {
+                        cout << sectionIndex.unknownCourseCount()
+                             << " sections of courses not in the catalog were ignored." << endl;
+                    }
+                }
+            }
+        }
+        else if (userChoice == "20" || userChoice == "21") {
+            if (!dataLoaded || loadedSections.empty()) {
+                cout << "Please load the data structure and section times first (options 1 and 19)."
+                     << endl;
+            }
+            else {
+                // Course IDs change when the catalog does.
+                if (!sectionIndex.isCurrent(catalogIndex)) {
+                    sectionIndex.build(loadedSections, catalogIndex);
+                }
+                string list;
+                if (userChoice == "20") {
+                    cout << "Enter the schedule's sections separated by commas (for example, CS200-01): ";
+                    getline(cin, list);
+                    printScheduleConflicts(catalogIndex, sectionIndex, list);
+                }
+                else {
+                    cout << "Enter the courses separated by commas: ";
+                    getline(cin, list);
+                    printConflictFreeSchedules(catalogIndex, sectionIndex, list);
+                }
+            }
+        }
+        else if (userChoice == "9") {
+            cout << "Thank you for using the ABCU Course Planner. Goodbye!" << endl;
+            break;
+        }
+        else {
+            // Handle any menu choices that are not valid.
+            cout << "Invalid choice. Please enter a number from the menu." << endl;
+        }
+    }
+
+    return 0;
+}